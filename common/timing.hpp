@@ -0,0 +1,16 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+
+/// <summary>
+/// Average time of a function in milliseconds
+/// </summary>
+inline double measureMs(const std::function<void()>& function, int repetitions) {
+    auto start{ std::chrono::steady_clock::now() };
+    for (int i{ 0 }; i < repetitions; ++i) {
+        function();
+    }
+    std::chrono::duration<double, std::milli> elapsed{ std::chrono::steady_clock::now() - start };
+    return elapsed.count() / repetitions;
+}
@@ -3,48 +3,43 @@
 #include <iostream>
 #include <stdexcept>
 #include <print>
+#include <memory>
+#include "frame_source.hpp"
 
 int main() {
 
     // Path to a video
     std::string path{ "../data/videos/chaplin.mp4" };
 
-    // Create object of video capture class
-    cv::VideoCapture cap(path);
+    // Create frame source, it decodes video on a background thread into recycled buffers
+    std::unique_ptr<FrameSource> source;
 
     // Chek if stream is open
     try {
-        if (!cap.isOpened()) {
-            throw std::runtime_error(std::format("Can't open video from given path: {}\n", path));
-        }
+        source = std::make_unique<FrameSource>(path);
     }
     catch (std::exception& e) {
         std::cerr << e.what();
+        return EXIT_FAILURE;
     }
 
     // Get information about video
-    double fps = cap.get(cv::CAP_PROP_FPS);
-    int width = cap.get(cv::CAP_PROP_FRAME_WIDTH);
-    int height = cap.get(cv::CAP_PROP_FRAME_HEIGHT);
+    double fps = source->getFps();
+    int width = source->getSize().width;
+    int height = source->getSize().height;
     std::println("Video properties: width, height, fps: {}x{}@{}fps", width, height, fps);
 
     // Set delay
-    auto delay = static_cast<int>(1000 / cap.get(cv::CAP_PROP_FPS));
+    auto delay = static_cast<int>(1000 / fps);
 
     // Create a new window with given name
     std::string window_name{ "Frame" };
     cv::namedWindow(window_name, cv::WINDOW_NORMAL);
 
-    // Main loop (until there is at least 1 frame in loaded video)
-    while (cap.isOpened()) {
-        // Create space for frames from video
-        cv::Mat frame;
-        cap.read(frame);
-
-        // If there is no frame break from main loop
-        if (frame.empty()) {
-            break;
-        }
+    // Main loop (until there is at least 1 decoded frame)
+    while (auto decoded = source->next()) {
+        // Frame buffer is reused by the source after this iteration
+        const cv::Mat& frame = decoded->image();
 
         // Show next frame
         cv::imshow(window_name, frame);
@@ -64,7 +59,9 @@ int main() {
         }
     }
 
+    std::println("Decoder: {:.2f} fps, frames waiting in queue: {}", source->getDecodeFps(), source->getQueueDepth());
+
     // Release stream
-    cap.release();
+    source->stop();
     cv::destroyWindow(window_name);
 }
@@ -3,33 +3,35 @@
 #include <iostream>
 #include <stdexcept>
 #include <print>
+#include <memory>
+#include "frame_source.hpp"
+#include "frame_sink.hpp"
 
 int main() {
 
     // Path to a video
     std::string path{ "../data/videos/chaplin.mp4" };
 
-    // Create object of video capture class
-    cv::VideoCapture cap(path);
+    // Create frame source, it decodes video on a background thread into recycled buffers
+    std::unique_ptr<FrameSource> source;
 
     // Chek if stream is open
     try {
-        if (!cap.isOpened()) {
-            throw std::runtime_error(std::format("Can't open video from given path: {}\n", path));
-        }
+        source = std::make_unique<FrameSource>(path);
     }
     catch (std::exception& e) {
         std::cerr << e.what();
+        return EXIT_FAILURE;
     }
 
     // Get information about video
-    double fps = cap.get(cv::CAP_PROP_FPS);
-    int width = cap.get(cv::CAP_PROP_FRAME_WIDTH);
-    int height = cap.get(cv::CAP_PROP_FRAME_HEIGHT);
+    double fps = source->getFps();
+    int width = source->getSize().width;
+    int height = source->getSize().height;
     std::println("Video properties: width, height, fps: {}x{}@{}fps", width, height, fps);
 
     // Set delay
-    auto delay = static_cast<int>(1000 / cap.get(cv::CAP_PROP_FPS));
+    auto delay = static_cast<int>(1000 / fps);
 
     // Create a new window with given name
     std::string window_name{ "Frame" };
@@ -41,24 +43,26 @@ int main() {
     double write_fps{ 10 };
     cv::Size write_size{ width, height };
 
-    cv::VideoWriter out(write_path, codec, write_fps, write_size);
-
-    // Main loop (until there is at least 1 frame in loaded video)
-    while (cap.isOpened()) {
-        // Create space for frames from video
-        cv::Mat frame;
-        cap.read(frame);
+    // Frames are encoded on a separate thread, so encoding doesn't add to the display loop latency
+    std::unique_ptr<FrameSink> out;
+    try {
+        out = std::make_unique<FrameSink>(write_path, codec, write_fps, write_size, 8, Backpressure::Block);
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what();
+        return EXIT_FAILURE;
+    }
 
-        // If there is no frame break from main loop
-        if (frame.empty()) {
-            break;
-        }
+    // Main loop (until there is at least 1 decoded frame)
+    while (auto decoded = source->next()) {
+        // Frame buffer is reused by the source after this iteration
+        const cv::Mat& frame = decoded->image();
 
         // Show next frame
         cv::imshow(window_name, frame);
 
         // Write frame into the file
-        out.write(frame);
+        out->write(frame);
 
         // Get a keystroke and set delay
         auto key = cv::waitKey(delay);
@@ -75,8 +79,12 @@ int main() {
         }
     }
 
+    std::println("Decoder: {:.2f} fps, frames waiting in queue: {}", source->getDecodeFps(), source->getQueueDepth());
+
     // Release stream
-    cap.release();
-    out.release(); // Release video writer object
+    source->stop();
+    out->stop(); // Encode queued frames and release video writer object
+    std::println("Encoder: written {}, dropped {}, encode {:.2f} ms, latency avg {:.2f} ms, max {:.2f} ms",
+        out->getWritten(), out->getDropped(), out->getAverageEncodeMs(), out->getAverageLatencyMs(), out->getMaxLatencyMs());
     cv::destroyWindow(window_name);
 }
@@ -0,0 +1,149 @@
+#include <opencv2/core.hpp>
+#include <opencv2/opencv.hpp>
+#include <iostream>
+#include <stdexcept>
+#include <print>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include "frame_source.hpp"
+#include "frame_sink.hpp"
+
+/// <summary>
+/// Converts a video to a different frame rate keeping its duration, so the output plays at the correct speed.
+/// Frames are picked (nearest) or blended (linear) at output timestamps and resized on the fly.
+/// Decoding, resampling and encoding run on separate threads.
+/// </summary>
+class FrameRateResampler {
+public:
+    FrameRateResampler(double source_fps, double target_fps, cv::Size target_size, bool blend)
+        : source_step_(1.0 / source_fps), target_step_(1.0 / target_fps), target_size_(target_size), blend_(blend) {
+        if (source_fps <= 0 || target_fps <= 0) {
+            throw std::runtime_error("Frame rates must be positive!\n");
+        }
+    }
+
+    /// <summary>
+    /// Adds the next source frame and emits every output frame with timestamp up to this frame
+    /// </summary>
+    template <typename Emit>
+    void push(const cv::Mat& frame, Emit&& emit) {
+        // Resize reuses the buffer of current frame
+        if (frame.size() == target_size_) {
+            frame.copyTo(current_);
+        }
+        else {
+            cv::resize(frame, current_, target_size_, 0, 0, cv::INTER_AREA);
+        }
+
+        const double current_time{ source_index_ * source_step_ };
+        while (output_index_ * target_step_ <= current_time + epsilon_) {
+            const double output_time{ output_index_ * target_step_ };
+            if (previous_.empty()) {
+                emit(current_);
+            }
+            else {
+                // Position of output timestamp between previous and current frame
+                double alpha{ (output_time - (current_time - source_step_)) / source_step_ };
+                if (blend_) {
+                    cv::addWeighted(previous_, 1.0 - alpha, current_, alpha, 0.0, blended_);
+                    emit(blended_);
+                }
+                else {
+                    emit(alpha < 0.5 ? previous_ : current_);
+                }
+            }
+            ++output_index_;
+        }
+
+        std::swap(previous_, current_);
+        ++source_index_;
+    }
+
+    std::size_t getOutputFrames() const {
+        return output_index_;
+    }
+
+    double getSourceDuration() const {
+        return source_index_ * source_step_;
+    }
+
+private:
+    double source_step_;
+    double target_step_;
+    cv::Size target_size_;
+    bool blend_;
+
+    cv::Mat previous_;
+    cv::Mat current_;
+    cv::Mat blended_;
+
+    std::size_t source_index_{ 0 };
+    std::size_t output_index_{ 0 };
+
+    static constexpr double epsilon_{ 1e-9 };
+};
+
+int main(int argc, char** argv) {
+    // Usage: 03_resample_video <input> <output> <fps> [width] [height] [nearest|blend]
+    std::string path{ argc > 1 ? argv[1] : "../data/videos/chaplin.mp4" };
+    std::string write_path{ argc > 2 ? argv[2] : "../data/videos/chaplin_10fps.mp4" };
+    double write_fps{ argc > 3 ? std::stod(argv[3]) : 10.0 };
+    int write_width{ argc > 4 ? std::stoi(argv[4]) : 0 };
+    int write_height{ argc > 5 ? std::stoi(argv[5]) : 0 };
+    std::string mode{ argc > 6 ? argv[6] : "blend" };
+
+    if (mode != "nearest" && mode != "blend") {
+        std::cerr << std::format("Unknown mode: {}, use nearest or blend\n", mode);
+        return EXIT_FAILURE;
+    }
+
+    std::unique_ptr<FrameSource> source;
+    std::unique_ptr<FrameSink> out;
+    std::unique_ptr<FrameRateResampler> resampler;
+    try {
+        source = std::make_unique<FrameSource>(path, 8);
+
+        // Missing width or height keeps aspect ratio of the source
+        cv::Size size{ source->getSize() };
+        cv::Size write_size{ size };
+        if (write_width > 0 && write_height > 0) {
+            write_size = { write_width, write_height };
+        }
+        else if (write_width > 0) {
+            write_size = { write_width, static_cast<int>(std::lround(static_cast<double>(size.height) * write_width / size.width)) };
+        }
+        else if (write_height > 0) {
+            write_size = { static_cast<int>(std::lround(static_cast<double>(size.width) * write_height / size.height)), write_height };
+        }
+
+        std::println("Input: {}x{}@{}fps, output: {}x{}@{}fps ({})",
+            size.width, size.height, source->getFps(), write_size.width, write_size.height, write_fps, mode);
+
+        out = std::make_unique<FrameSink>(write_path, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), write_fps, write_size, 8, Backpressure::Block);
+        resampler = std::make_unique<FrameRateResampler>(source->getFps(), write_fps, write_size, mode == "blend");
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what();
+        return EXIT_FAILURE;
+    }
+
+    auto start{ std::chrono::steady_clock::now() };
+
+    while (auto decoded = source->next()) {
+        resampler->push(decoded->image(), [&out](const cv::Mat& frame) { out->write(frame); });
+    }
+
+    source->stop();
+    out->stop();
+    std::chrono::duration<double> elapsed{ std::chrono::steady_clock::now() - start };
+
+    std::println("Written {} frames ({} dropped), decoder {:.2f} fps, encode {:.2f} ms/frame",
+        out->getWritten(), out->getDropped(), source->getDecodeFps(), out->getAverageEncodeMs());
+    std::println("Processed {:.2f} s of video in {:.2f} s: {:.2f}x real time",
+        resampler->getSourceDuration(), elapsed.count(),
+        elapsed.count() > 0 ? resampler->getSourceDuration() / elapsed.count() : 0.0);
+
+    return 0;
+}
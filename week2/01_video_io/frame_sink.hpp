@@ -0,0 +1,205 @@
+#pragma once
+
+#include <iostream>
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+#include <stdexcept>
+#include <format>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <tuple>
+#include <algorithm>
+
+/// <summary>
+/// What FrameSink does with a new frame when its queue is full
+/// </summary>
+enum class Backpressure {
+    Block,      // wait until the encoder frees a buffer
+    DropOldest, // replace the oldest queued frame
+    DropNewest  // drop the frame that is being written
+};
+
+/// <summary>
+/// Owns cv::VideoWriter and encodes frames on a dedicated thread. Frames are copied into a fixed pool of buffers
+/// behind a bounded queue, so write() costs one copy instead of the whole encoding.
+/// </summary>
+class FrameSink {
+public:
+    FrameSink(const std::string& path, int fourcc, double fps, cv::Size size,
+        std::size_t queue_size = 4, Backpressure backpressure = Backpressure::Block)
+        : writer_(path, fourcc, fps, size), buffers_(std::max<std::size_t>(queue_size, 1) + 1),
+        capacity_(std::max<std::size_t>(queue_size, 1)), backpressure_(backpressure) {
+        if (!writer_.isOpened()) {
+            throw std::runtime_error(std::format("Can't open video writer for: {}\n", path));
+        }
+        for (std::size_t slot{ 0 }; slot < buffers_.size(); ++slot) {
+            free_.push_back(slot);
+        }
+        encode_thread_ = std::thread(&FrameSink::encodeLoop, this);
+    }
+
+    ~FrameSink() {
+        stop();
+    }
+
+    FrameSink(const FrameSink& other) = delete;
+    FrameSink(FrameSink&& other) = delete;
+    FrameSink& operator=(const FrameSink& other) = delete;
+    FrameSink& operator=(FrameSink&& other) = delete;
+
+    /// <summary>
+    /// Queues a copy of the frame for encoding. Should be called from a single producer thread.
+    /// </summary>
+    /// <returns>false if the frame was dropped</returns>
+    bool write(const cv::Mat& frame) {
+        std::size_t slot{};
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (stopped_) {
+                return false;
+            }
+
+            if (free_.empty() || ready_.size() >= capacity_) {
+                if (backpressure_ == Backpressure::DropNewest) {
+                    ++dropped_;
+                    return false;
+                }
+                if (backpressure_ == Backpressure::DropOldest && !ready_.empty()) {
+                    free_.push_back(ready_.front().first);
+                    ready_.pop_front();
+                    ++dropped_;
+                }
+                else {
+                    free_cv_.wait(lock, [this] { return (!free_.empty() && ready_.size() < capacity_) || stopped_; });
+                    if (stopped_) {
+                        return false;
+                    }
+                }
+            }
+            slot = free_.front();
+            free_.pop_front();
+        }
+
+        // Buffer is owned by this thread now, copy reuses its memory when size and type don't change
+        frame.copyTo(buffers_[slot]);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ready_.emplace_back(slot, std::chrono::steady_clock::now());
+        }
+        ready_cv_.notify_one();
+        return true;
+    }
+
+    /// <summary>
+    /// Encodes frames left in the queue and releases the writer
+    /// </summary>
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopped_) {
+                return;
+            }
+            stopped_ = true;
+        }
+        ready_cv_.notify_all();
+        free_cv_.notify_all();
+        if (encode_thread_.joinable()) {
+            encode_thread_.join();
+        }
+        writer_.release();
+    }
+
+    std::size_t getWritten() const {
+        return written_;
+    }
+
+    std::size_t getDropped() const {
+        return dropped_;
+    }
+
+    std::size_t getQueueDepth() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return ready_.size();
+    }
+
+    /// <summary>
+    /// Average time between write() and the end of encoding, in milliseconds
+    /// </summary>
+    double getAverageLatencyMs() const {
+        return written_ > 0 ? latency_total_us_ / 1000.0 / written_ : 0.0;
+    }
+
+    double getMaxLatencyMs() const {
+        return latency_max_us_ / 1000.0;
+    }
+
+    /// <summary>
+    /// Average time of cv::VideoWriter::write alone, in milliseconds
+    /// </summary>
+    double getAverageEncodeMs() const {
+        return written_ > 0 ? encode_total_us_ / 1000.0 / written_ : 0.0;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    cv::VideoWriter writer_;
+    std::vector<cv::Mat> buffers_;
+    std::size_t capacity_;
+    Backpressure backpressure_;
+
+    std::deque<std::size_t> free_;
+    std::deque<std::pair<std::size_t, Clock::time_point>> ready_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable free_cv_;
+    std::condition_variable ready_cv_;
+    bool stopped_{ false };
+    std::thread encode_thread_;
+
+    // Statistics
+    std::atomic<std::size_t> written_{ 0 };
+    std::atomic<std::size_t> dropped_{ 0 };
+    std::atomic<long long> latency_total_us_{ 0 };
+    std::atomic<long long> latency_max_us_{ 0 };
+    std::atomic<long long> encode_total_us_{ 0 };
+
+    void encodeLoop() {
+        while (true) {
+            std::size_t slot{};
+            Clock::time_point queued;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                ready_cv_.wait(lock, [this] { return !ready_.empty() || stopped_; });
+                if (ready_.empty()) {
+                    return;
+                }
+                std::tie(slot, queued) = ready_.front();
+                ready_.pop_front();
+            }
+
+            auto start{ Clock::now() };
+            writer_.write(buffers_[slot]);
+            auto end{ Clock::now() };
+
+            long long latency{ std::chrono::duration_cast<std::chrono::microseconds>(end - queued).count() };
+            encode_total_us_ += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+            latency_total_us_ += latency;
+            latency_max_us_ = std::max(latency_max_us_.load(), latency);
+            ++written_;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                free_.push_back(slot);
+            }
+            free_cv_.notify_one();
+        }
+    }
+};
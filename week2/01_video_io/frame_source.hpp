@@ -0,0 +1,231 @@
+#pragma once
+
+#include <iostream>
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+#include <stdexcept>
+#include <format>
+#include <string>
+#include <vector>
+#include <deque>
+#include <optional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+/// <summary>
+/// Decodes video on a background thread into a fixed pool of frame buffers.
+/// Decoded frames wait in a bounded queue, buffers go back to the pool when a consumer releases its Frame,
+/// so after the first frames no allocation happens and the consumer never waits for the decoder if it keeps up.
+/// FrameSource must outlive every Frame it returned.
+/// </summary>
+class FrameSource {
+public:
+    /// <summary>
+    /// Decoded frame, its buffer goes back to the pool when the object is destroyed
+    /// </summary>
+    class Frame {
+    public:
+        Frame(FrameSource* source, std::size_t slot, std::size_t index) : source_(source), slot_(slot), index_(index) {}
+
+        ~Frame() {
+            release();
+        }
+
+        Frame(const Frame& other) = delete;
+        Frame& operator=(const Frame& other) = delete;
+
+        Frame(Frame&& other) noexcept : source_(other.source_), slot_(other.slot_), index_(other.index_) {
+            other.source_ = nullptr;
+        }
+
+        Frame& operator=(Frame&& other) noexcept {
+            if (this != &other) {
+                release();
+                source_ = other.source_;
+                slot_ = other.slot_;
+                index_ = other.index_;
+                other.source_ = nullptr;
+            }
+            return *this;
+        }
+
+        /// <summary>
+        /// Image stays valid until the Frame is destroyed, clone it to keep it longer
+        /// </summary>
+        cv::Mat& image() {
+            return source_->buffers_.at(slot_);
+        }
+
+        const cv::Mat& image() const {
+            return source_->buffers_.at(slot_);
+        }
+
+        /// <summary>
+        /// Index of the frame in the video, starting from 0
+        /// </summary>
+        std::size_t index() const {
+            return index_;
+        }
+
+        void release() {
+            if (source_) {
+                source_->recycle(slot_);
+                source_ = nullptr;
+            }
+        }
+
+    private:
+        FrameSource* source_;
+        std::size_t slot_;
+        std::size_t index_;
+    };
+
+    FrameSource(const std::string& path, std::size_t pool_size = 4) : cap_(path), buffers_(std::max<std::size_t>(pool_size, 2)) {
+        if (!cap_.isOpened()) {
+            throw std::runtime_error(std::format("Can't open video from given path: {}\n", path));
+        }
+        fps_ = cap_.get(cv::CAP_PROP_FPS);
+        size_ = { static_cast<int>(cap_.get(cv::CAP_PROP_FRAME_WIDTH)), static_cast<int>(cap_.get(cv::CAP_PROP_FRAME_HEIGHT)) };
+        frame_count_ = static_cast<int>(cap_.get(cv::CAP_PROP_FRAME_COUNT));
+
+        for (std::size_t slot{ 0 }; slot < buffers_.size(); ++slot) {
+            free_.push_back(slot);
+        }
+        decode_thread_ = std::thread(&FrameSource::decodeLoop, this);
+    }
+
+    ~FrameSource() {
+        stop();
+    }
+
+    FrameSource(const FrameSource& other) = delete;
+    FrameSource(FrameSource&& other) = delete;
+    FrameSource& operator=(const FrameSource& other) = delete;
+    FrameSource& operator=(FrameSource&& other) = delete;
+
+    /// <summary>
+    /// Next decoded frame, blocks until it is available. Returns std::nullopt at the end of the video.
+    /// </summary>
+    std::optional<Frame> next() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_cv_.wait(lock, [this] { return !ready_.empty() || finished_; });
+        if (ready_.empty()) {
+            return std::nullopt;
+        }
+        auto [slot, index] = ready_.front();
+        ready_.pop_front();
+        return std::optional<Frame>{ std::in_place, this, slot, index };
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopped_) {
+                return;
+            }
+            stopped_ = true;
+        }
+        free_cv_.notify_all();
+        if (decode_thread_.joinable()) {
+            decode_thread_.join();
+        }
+        cap_.release();
+    }
+
+    double getFps() const {
+        return fps_;
+    }
+
+    cv::Size getSize() const {
+        return size_;
+    }
+
+    int getFrameCount() const {
+        return frame_count_;
+    }
+
+    /// <summary>
+    /// Decoded frames per second of decoding time (without time spent waiting for free buffers)
+    /// </summary>
+    double getDecodeFps() const {
+        auto seconds{ decode_nanoseconds_.load() / 1e9 };
+        return seconds > 0 ? decoded_.load() / seconds : 0.0;
+    }
+
+    /// <summary>
+    /// Number of decoded frames waiting for the consumer
+    /// </summary>
+    std::size_t getQueueDepth() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return ready_.size();
+    }
+
+    std::size_t getPoolSize() const {
+        return buffers_.size();
+    }
+
+private:
+    cv::VideoCapture cap_;
+    std::vector<cv::Mat> buffers_;
+    std::deque<std::size_t> free_;
+    std::deque<std::pair<std::size_t, std::size_t>> ready_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable free_cv_;
+    std::condition_variable ready_cv_;
+    bool finished_{ false };
+    bool stopped_{ false };
+    std::thread decode_thread_;
+
+    double fps_{};
+    cv::Size size_{};
+    int frame_count_{};
+
+    std::atomic<std::size_t> decoded_{ 0 };
+    std::atomic<long long> decode_nanoseconds_{ 0 };
+
+    void recycle(std::size_t slot) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            free_.push_back(slot);
+        }
+        free_cv_.notify_one();
+    }
+
+    void decodeLoop() {
+        std::size_t index{ 0 };
+        while (true) {
+            std::size_t slot{};
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                free_cv_.wait(lock, [this] { return !free_.empty() || stopped_; });
+                if (stopped_) {
+                    break;
+                }
+                slot = free_.front();
+                free_.pop_front();
+            }
+
+            // cv::VideoCapture::read reuses the buffer when size and type don't change
+            auto start{ std::chrono::steady_clock::now() };
+            bool ok{ cap_.read(buffers_[slot]) && !buffers_[slot].empty() };
+            decode_nanoseconds_ += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!ok) {
+                free_.push_back(slot);
+                break;
+            }
+            ++decoded_;
+            ready_.emplace_back(slot, index++);
+            ready_cv_.notify_one();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        finished_ = true;
+        ready_cv_.notify_all();
+    }
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <stdexcept>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+
+/// <summary>
+/// Output buffers of multiThreshold, nullptr skips the threshold type.
+/// Buffers are (re)allocated only if their size or type doesn't match the input.
+/// </summary>
+struct ThresholdOutputs {
+    cv::Mat* binary{ nullptr };
+    cv::Mat* binary_inv{ nullptr };
+    cv::Mat* truncate{ nullptr };
+    cv::Mat* to_zero{ nullptr };
+    cv::Mat* to_zero_inv{ nullptr };
+};
+
+/// <summary>
+/// Produces any subset of THRESH_BINARY, THRESH_BINARY_INV, THRESH_TRUNC, THRESH_TOZERO and THRESH_TOZERO_INV
+/// in a single pass over an 8-bit image. Image is split into bands of rows processed in parallel, every source row
+/// is read once from memory and stays in cache while the requested outputs are written. Inner loops are branchless,
+/// so the compiler vectorizes them.
+/// </summary>
+/// <param name="src">CV_8U image with any number of channels</param>
+/// <param name="thresh">Threshold, same meaning as in cv::threshold</param>
+/// <param name="max_value">Value of pixels above threshold for binary types</param>
+/// <param name="outputs">Caller provided buffers</param>
+/// <param name="band_rows">Number of rows processed by one task</param>
+inline void multiThreshold(const cv::Mat& src, int thresh, int max_value, const ThresholdOutputs& outputs, int band_rows = 32) {
+    if (src.empty() || src.depth() != CV_8U) {
+        throw std::runtime_error("Multi threshold works only with non-empty 8-bit images!\n");
+    }
+
+    std::array<cv::Mat*, 5> buffers{ outputs.binary, outputs.binary_inv, outputs.truncate, outputs.to_zero, outputs.to_zero_inv };
+    for (auto* buffer : buffers) {
+        if (buffer) {
+            buffer->create(src.size(), src.type());
+        }
+    }
+
+    // cv::threshold on 8-bit images compares v > thresh, so everything below -1 and above 255 behaves the same
+    const int t{ std::clamp(thresh, -1, 255) };
+    const uchar max_val{ cv::saturate_cast<uchar>(max_value) };
+    const uchar trunc_val{ cv::saturate_cast<uchar>(t) };
+    const int width{ src.cols * src.channels() };
+
+    band_rows = std::max(band_rows, 1);
+    std::vector<int> bands((src.rows + band_rows - 1) / band_rows);
+    std::iota(bands.begin(), bands.end(), 0);
+
+    std::for_each(std::execution::par, bands.begin(), bands.end(), [&](int band) {
+        const int end{ std::min((band + 1) * band_rows, src.rows) };
+        for (int y{ band * band_rows }; y < end; ++y) {
+            const uchar* s{ src.ptr<uchar>(y) };
+
+            if (outputs.binary) {
+                uchar* d{ outputs.binary->ptr<uchar>(y) };
+                for (int x{ 0 }; x < width; ++x) {
+                    d[x] = s[x] > t ? max_val : 0;
+                }
+            }
+            if (outputs.binary_inv) {
+                uchar* d{ outputs.binary_inv->ptr<uchar>(y) };
+                for (int x{ 0 }; x < width; ++x) {
+                    d[x] = s[x] > t ? 0 : max_val;
+                }
+            }
+            if (outputs.truncate) {
+                uchar* d{ outputs.truncate->ptr<uchar>(y) };
+                for (int x{ 0 }; x < width; ++x) {
+                    d[x] = std::min(s[x], trunc_val);
+                }
+            }
+            if (outputs.to_zero) {
+                uchar* d{ outputs.to_zero->ptr<uchar>(y) };
+                for (int x{ 0 }; x < width; ++x) {
+                    d[x] = s[x] > t ? s[x] : 0;
+                }
+            }
+            if (outputs.to_zero_inv) {
+                uchar* d{ outputs.to_zero_inv->ptr<uchar>(y) };
+                for (int x{ 0 }; x < width; ++x) {
+                    d[x] = s[x] > t ? 0 : s[x];
+                }
+            }
+        }
+        });
+}
@@ -3,6 +3,10 @@
 #include <iostream>
 #include <stdexcept>
 #include <future>
+#include <array>
+#include <print>
+#include <chrono>
+#include "multi_threshold.hpp"
 
 cv::Mat binaryThreshold(const cv::Mat& img, int thresh, int max_value) {
     cv::Mat binary_thresh;
@@ -56,17 +60,49 @@ int main() {
     int thresh{ 100 };
     int max_value{ 150 };
 
-    auto binary_future = std::async(std::launch::async, binaryThreshold, std::cref(img), thresh, max_value);
-    auto binary_inv_future = std::async(std::launch::async, inverseBinaryThreshold, std::cref(img), thresh, max_value);
-    auto truncate_future = std::async(std::launch::async, truncateThreshold, std::cref(img), thresh, max_value);
-    auto to_zero_future = std::async(std::launch::async, toZeroThreshold, std::cref(img), thresh, max_value);
-    auto to_zero_inv_future = std::async(std::launch::async, inverseToZeroThreshold, std::cref(img), thresh, max_value);
-
-    cv::Mat binary_thresh{ binary_future.get() };
-    cv::Mat binary_inv_thresh{ binary_inv_future.get() };
-    cv::Mat truncate_thresh{ truncate_future.get() };
-    cv::Mat to_zero_thresh{ to_zero_future.get() };
-    cv::Mat to_zero_inv_thresh{ to_zero_inv_future.get() };
+    // Five cv::threshold calls on their own threads, every call reads the image and allocates output
+    auto asyncThreshold = [&img, thresh, max_value] {
+        auto binary_future = std::async(std::launch::async, binaryThreshold, std::cref(img), thresh, max_value);
+        auto binary_inv_future = std::async(std::launch::async, inverseBinaryThreshold, std::cref(img), thresh, max_value);
+        auto truncate_future = std::async(std::launch::async, truncateThreshold, std::cref(img), thresh, max_value);
+        auto to_zero_future = std::async(std::launch::async, toZeroThreshold, std::cref(img), thresh, max_value);
+        auto to_zero_inv_future = std::async(std::launch::async, inverseToZeroThreshold, std::cref(img), thresh, max_value);
+        return std::array<cv::Mat, 5>{ binary_future.get(), binary_inv_future.get(), truncate_future.get(),
+            to_zero_future.get(), to_zero_inv_future.get() };
+        };
+
+    // One pass producing all five outputs into buffers allocated once
+    cv::Mat binary_thresh, binary_inv_thresh, truncate_thresh, to_zero_thresh, to_zero_inv_thresh;
+    ThresholdOutputs outputs{ &binary_thresh, &binary_inv_thresh, &truncate_thresh, &to_zero_thresh, &to_zero_inv_thresh };
+    multiThreshold(img, thresh, max_value, outputs);
+
+    // Both versions must give the same result
+    auto reference{ asyncThreshold() };
+    std::array<const cv::Mat*, 5> fused{ &binary_thresh, &binary_inv_thresh, &truncate_thresh, &to_zero_thresh, &to_zero_inv_thresh };
+    for (std::size_t i{ 0 }; i < reference.size(); ++i) {
+        if (cv::norm(reference[i], *fused[i], cv::NORM_INF) != 0) {
+            std::cerr << std::format("Fused output {} differs from cv::threshold!\n", i);
+        }
+    }
+
+    // Benchmark
+    constexpr int iterations{ 200 };
+    auto start{ std::chrono::steady_clock::now() };
+    for (int i{ 0 }; i < iterations; ++i) {
+        reference = asyncThreshold();
+    }
+    std::chrono::duration<double, std::milli> async_time{ std::chrono::steady_clock::now() - start };
+
+    start = std::chrono::steady_clock::now();
+    for (int i{ 0 }; i < iterations; ++i) {
+        multiThreshold(img, thresh, max_value, outputs);
+    }
+    std::chrono::duration<double, std::milli> fused_time{ std::chrono::steady_clock::now() - start };
+
+    std::println("{}x{} image, {} iterations", img.cols, img.rows, iterations);
+    std::println("std::async + cv::threshold: {:.3f} ms per image", async_time.count() / iterations);
+    std::println("Fused multi threshold:      {:.3f} ms per image ({:.2f}x)", fused_time.count() / iterations,
+        fused_time.count() > 0 ? async_time.count() / fused_time.count() : 0.0);
 
     cv::imshow("Original", img);
     cv::imshow("Binary Threshold", binary_thresh);
@@ -2,6 +2,34 @@
 #include <opencv2/opencv.hpp>
 #include <iostream>
 #include <stdexcept>
+#include <print>
+#include <array>
+#include <string>
+#include "morphology_engine.hpp"
+#include "../../common/timing.hpp"
+
+/// <summary>
+/// Compares cv::erode with MorphologyEngine over growing kernels of every shape
+/// </summary>
+void benchmark(const cv::Mat& img, const MorphologyEngine& engine) {
+    constexpr int repetitions{ 10 };
+    const std::array<std::pair<int, std::string>, 3> shapes{ { { cv::MORPH_RECT, "rect" }, { cv::MORPH_CROSS, "cross" }, { cv::MORPH_ELLIPSE, "ellipse" } } };
+    const std::array<std::pair<int, int>, 8> sizes{ { { 3, 1 }, { 7, 1 }, { 11, 1 }, { 15, 1 }, { 23, 1 }, { 31, 1 }, { 61, 1 }, { 23, 20 } } };
+
+    std::println("{}x{} image, {} channels", img.cols, img.rows, img.channels());
+    std::println("{:>8} {:>6} {:>10} {:>12} {:>12} {:>8} {:>6}", "shape", "size", "iterations", "cv [ms]", "engine [ms]", "speedup", "same");
+    for (const auto& [shape, name] : shapes) {
+        for (auto [size, iterations] : sizes) {
+            auto element{ cv::getStructuringElement(shape, cv::Size(size, size)) };
+            cv::Mat reference, result;
+            double cv_ms{ measureMs([&] { cv::erode(img, reference, element, cv::Point(-1, -1), iterations); }, repetitions) };
+            double engine_ms{ measureMs([&] { engine.erode(img, result, element, cv::Point(-1, -1), iterations); }, repetitions) };
+            bool same{ cv::norm(reference, result, cv::NORM_INF) == 0 };
+            std::println("{:>8} {:>6} {:>10} {:>12.3f} {:>12.3f} {:>8.2f} {:>6}", name, size, iterations, cv_ms, engine_ms,
+                engine_ms > 0 ? cv_ms / engine_ms : 0.0, same);
+        }
+    }
+}
 
 int main() {
     // Path to an image 
@@ -24,6 +52,9 @@ int main() {
         return EXIT_FAILURE;
     }
 
+    MorphologyEngine engine;
+    benchmark(erosion, engine);
+
     int kernel_size{ 7 };
     auto big_kernel{ cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(kernel_size, kernel_size)) };
     cv::namedWindow("Big Kernel", cv::WINDOW_NORMAL);
@@ -33,21 +64,21 @@ int main() {
 
     // Dilatation version
     cv::Mat dilatation_big_kernel;
-    cv::dilate(dilation, dilatation_big_kernel, big_kernel);
+    engine.dilate(dilation, dilatation_big_kernel, big_kernel);
 
     cv::Mat dilation_small_kernel_one_iteration;
     cv::Mat dilation_small_kernel_two_iterations;
-    cv::dilate(dilation, dilation_small_kernel_one_iteration, small_kernel, cv::Point(-1, -1), 1);
-    cv::dilate(dilation, dilation_small_kernel_two_iterations, small_kernel, cv::Point(-1, -1), 2);
+    engine.dilate(dilation, dilation_small_kernel_one_iteration, small_kernel, cv::Point(-1, -1), 1);
+    engine.dilate(dilation, dilation_small_kernel_two_iterations, small_kernel, cv::Point(-1, -1), 2);
 
     // Erosion version
     cv::Mat erosion_big_kernel;
-    cv::erode(erosion, erosion_big_kernel, big_kernel);
+    engine.erode(erosion, erosion_big_kernel, big_kernel);
 
     cv::Mat erosion_small_kernel_one_iteration;
     cv::Mat erosion_small_kernel_two_iterations;
-    cv::erode(erosion, erosion_small_kernel_one_iteration, small_kernel, cv::Point(-1, -1), 1);
-    cv::erode(erosion, erosion_small_kernel_two_iterations, small_kernel, cv::Point(-1, -1), 2);
+    engine.erode(erosion, erosion_small_kernel_one_iteration, small_kernel, cv::Point(-1, -1), 1);
+    engine.erode(erosion, erosion_small_kernel_two_iterations, small_kernel, cv::Point(-1, -1), 2);
 
     cv::imshow("Dilation", dilation);
     cv::imshow("Erosion", erosion);
@@ -0,0 +1,365 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <stdexcept>
+#include <format>
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <cstring>
+#include <tuple>
+
+/// <summary>
+/// Rectangle of a structuring element, offsets are relative to the anchor and inclusive
+/// </summary>
+struct ElementRect {
+    int x0, x1;
+    int y0, y1;
+
+    bool contains(const ElementRect& other) const {
+        return x0 <= other.x0 && x1 >= other.x1 && y0 <= other.y0 && y1 >= other.y1;
+    }
+};
+
+/// <summary>
+/// Erosion and dilation of 8-bit images with cost independent of the kernel size.
+/// Structuring element is split into rectangles whose union is the element (one for MORPH_RECT, two lines for MORPH_CROSS,
+/// one rectangle per distinct row width for MORPH_ELLIPSE). Every rectangle is a horizontal and a vertical line pass
+/// computed with van Herk/Gil-Werman algorithm - 3 min/max operations per pixel whatever the line length is.
+/// Iterations of a rectangular element are folded into one larger rectangle.
+/// Horizontal passes run on bands of rows, vertical passes on strips of columns, both in parallel.
+/// Results are identical to cv::erode/cv::dilate with the default border. Other depths, elements with more than one
+/// run of non-zero values in a row and custom borders fall back to OpenCV.
+/// </summary>
+class MorphologyEngine {
+public:
+    MorphologyEngine(int band_rows = 32, int strip_bytes = 256) : band_rows_(std::max(band_rows, 1)), strip_bytes_(std::max(strip_bytes, 1)) {}
+
+    void erode(const cv::Mat& src, cv::Mat& dst, const cv::Mat& element, cv::Point anchor = { -1, -1 }, int iterations = 1) const {
+        apply<true>(src, dst, element, anchor, iterations);
+    }
+
+    void dilate(const cv::Mat& src, cv::Mat& dst, const cv::Mat& element, cv::Point anchor = { -1, -1 }, int iterations = 1) const {
+        apply<false>(src, dst, element, anchor, iterations);
+    }
+
+    /// <summary>
+    /// Same operations as cv::morphologyEx, composed from erode and dilate of this engine
+    /// </summary>
+    void morphologyEx(const cv::Mat& src, cv::Mat& dst, int op, const cv::Mat& element, cv::Point anchor = { -1, -1 }, int iterations = 1) const {
+        cv::Mat temp;
+        switch (op) {
+        case cv::MORPH_ERODE:
+            erode(src, dst, element, anchor, iterations);
+            break;
+        case cv::MORPH_DILATE:
+            dilate(src, dst, element, anchor, iterations);
+            break;
+        case cv::MORPH_OPEN:
+            erode(src, temp, element, anchor, iterations);
+            dilate(temp, dst, element, anchor, iterations);
+            break;
+        case cv::MORPH_CLOSE:
+            dilate(src, temp, element, anchor, iterations);
+            erode(temp, dst, element, anchor, iterations);
+            break;
+        case cv::MORPH_GRADIENT: {
+            cv::Mat eroded;
+            erode(src, eroded, element, anchor, iterations);
+            dilate(src, temp, element, anchor, iterations);
+            cv::subtract(temp, eroded, dst);
+            break;
+        }
+        case cv::MORPH_TOPHAT:
+            morphologyEx(src, temp, cv::MORPH_OPEN, element, anchor, iterations);
+            cv::subtract(src, temp, dst);
+            break;
+        case cv::MORPH_BLACKHAT:
+            morphologyEx(src, temp, cv::MORPH_CLOSE, element, anchor, iterations);
+            cv::subtract(temp, src, dst);
+            break;
+        default:
+            cv::morphologyEx(src, dst, op, element, anchor, iterations);
+        }
+    }
+
+    /// <summary>
+    /// Splits structuring element into rectangles. Every distinct row run becomes a rectangle as tall as the rows
+    /// which contain it, rectangles inside other rectangles are removed.
+    /// </summary>
+    /// <returns>std::nullopt if a row of the element has more than one run of non-zero values or the element is empty</returns>
+    static std::optional<std::vector<ElementRect>> decompose(const cv::Mat& element, cv::Point anchor = { -1, -1 }) {
+        if (element.empty() || element.type() != CV_8U) {
+            return std::nullopt;
+        }
+        anchor = normalizeAnchor(element, anchor);
+
+        // Run of every row, x0 > x1 for empty rows
+        std::vector<std::pair<int, int>> runs(element.rows, { 1, 0 });
+        for (int y{ 0 }; y < element.rows; ++y) {
+            const uchar* row{ element.ptr<uchar>(y) };
+            int first{ -1 };
+            int last{ -1 };
+            for (int x{ 0 }; x < element.cols; ++x) {
+                if (row[x]) {
+                    if (last >= 0 && last != x - 1) {
+                        return std::nullopt;
+                    }
+                    if (first < 0) {
+                        first = x;
+                    }
+                    last = x;
+                }
+            }
+            if (first >= 0) {
+                runs[y] = { first - anchor.x, last - anchor.x };
+            }
+        }
+
+        auto distinct{ runs };
+        std::erase_if(distinct, [](const auto& run) { return run.first > run.second; });
+        if (distinct.empty()) {
+            return std::nullopt;
+        }
+        std::ranges::sort(distinct);
+        distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+
+        std::vector<ElementRect> rects;
+        for (const auto& [x0, x1] : distinct) {
+            int start{ -1 };
+            for (int y{ 0 }; y <= element.rows; ++y) {
+                bool covers{ y < element.rows && runs[y].first <= x0 && runs[y].second >= x1 };
+                if (covers && start < 0) {
+                    start = y;
+                }
+                else if (!covers && start >= 0) {
+                    rects.push_back({ x0, x1, start - anchor.y, y - 1 - anchor.y });
+                    start = -1;
+                }
+            }
+        }
+
+        std::vector<ElementRect> result;
+        for (std::size_t i{ 0 }; i < rects.size(); ++i) {
+            bool inside{ false };
+            for (std::size_t j{ 0 }; j < rects.size() && !inside; ++j) {
+                inside = i != j && rects[j].contains(rects[i]);
+            }
+            if (!inside) {
+                result.push_back(rects[i]);
+            }
+        }
+        return result;
+    }
+
+private:
+    int band_rows_;
+    int strip_bytes_;
+
+    static cv::Point normalizeAnchor(const cv::Mat& element, cv::Point anchor) {
+        return { anchor.x < 0 ? element.cols / 2 : anchor.x, anchor.y < 0 ? element.rows / 2 : anchor.y };
+    }
+
+    template <bool Erode>
+    static uchar op(uchar a, uchar b) {
+        if constexpr (Erode) {
+            return std::min(a, b);
+        }
+        else {
+            return std::max(a, b);
+        }
+    }
+
+    /// <summary>
+    /// Pixels outside of the image never change the result
+    /// </summary>
+    template <bool Erode>
+    static constexpr uchar neutral() {
+        return Erode ? 255 : 0;
+    }
+
+    template <bool Erode>
+    void apply(const cv::Mat& src, cv::Mat& dst, const cv::Mat& element, cv::Point anchor, int iterations) const {
+        auto rects{ decompose(element, anchor) };
+        if (src.depth() != CV_8U || !rects) {
+            if constexpr (Erode) {
+                cv::erode(src, dst, element, anchor, iterations);
+            }
+            else {
+                cv::dilate(src, dst, element, anchor, iterations);
+            }
+            return;
+        }
+
+        if (iterations <= 0) {
+            src.copyTo(dst);
+            return;
+        }
+
+        // n iterations of a rectangle are one rectangle n times bigger
+        if (rects->size() == 1) {
+            auto& rect{ rects->front() };
+            rect = { rect.x0 * iterations, rect.x1 * iterations, rect.y0 * iterations, rect.y1 * iterations };
+            iterations = 1;
+        }
+
+        cv::Mat current{ src };
+        for (int i{ 0 }; i < iterations; ++i) {
+            cv::Mat output(src.size(), src.type());
+            pass<Erode>(current, output, *rects);
+            current = output;
+        }
+        dst = current;
+    }
+
+    /// <summary>
+    /// One erosion or dilation with the union of rectangles. Rectangles with the same row run share the horizontal pass.
+    /// </summary>
+    template <bool Erode>
+    void pass(const cv::Mat& src, cv::Mat& dst, std::vector<ElementRect> rects) const {
+        std::ranges::sort(rects, [](const ElementRect& a, const ElementRect& b) { return std::tie(a.x0, a.x1) < std::tie(b.x0, b.x1); });
+
+        cv::Mat horizontal;
+        bool accumulate{ false };
+        for (std::size_t i{ 0 }; i < rects.size(); ++i) {
+            const auto& rect{ rects[i] };
+            if (i == 0 || rect.x0 != rects[i - 1].x0 || rect.x1 != rects[i - 1].x1) {
+                if (rect.x0 == 0 && rect.x1 == 0) {
+                    horizontal = src;
+                }
+                else {
+                    horizontal.release();
+                    horizontalPass<Erode>(src, horizontal, rect.x0, rect.x1);
+                }
+            }
+            verticalPass<Erode>(horizontal, dst, rect.y0, rect.y1, accumulate);
+            accumulate = true;
+        }
+    }
+
+    /// <summary>
+    /// van Herk/Gil-Werman running min/max over a padded line. Values are interleaved with given stride, so the same
+    /// code filters pixels of a row (stride = channels) and whole rows of a column strip (stride = strip width).
+    /// </summary>
+    /// <param name="padded">len values, value i is the neighbour at offset i of output 0</param>
+    /// <param name="window">Length of the line</param>
+    /// <param name="out">Output, consecutive values are out_step bytes apart</param>
+    /// <param name="count">Number of outputs, len = count + window - 1</param>
+    template <bool Erode>
+    static void lineFilter(const uchar* padded, int len, int window, int stride, uchar* forward, uchar* backward,
+        uchar* out, std::size_t out_step, int count, bool accumulate) {
+        // Running min/max from the start of every block of window values
+        for (int i{ 0 }; i < len; ++i) {
+            const uchar* p{ padded + static_cast<std::size_t>(i) * stride };
+            uchar* f{ forward + static_cast<std::size_t>(i) * stride };
+            if (i % window == 0) {
+                std::memcpy(f, p, stride);
+            }
+            else {
+                const uchar* previous{ f - stride };
+                for (int k{ 0 }; k < stride; ++k) {
+                    f[k] = op<Erode>(previous[k], p[k]);
+                }
+            }
+        }
+
+        // Running min/max to the end of every block
+        for (int i{ len - 1 }; i >= 0; --i) {
+            const uchar* p{ padded + static_cast<std::size_t>(i) * stride };
+            uchar* b{ backward + static_cast<std::size_t>(i) * stride };
+            if (i == len - 1 || (i + 1) % window == 0) {
+                std::memcpy(b, p, stride);
+            }
+            else {
+                const uchar* next{ b + stride };
+                for (int k{ 0 }; k < stride; ++k) {
+                    b[k] = op<Erode>(next[k], p[k]);
+                }
+            }
+        }
+
+        // Every window spans at most two blocks: end of one and start of the next
+        for (int i{ 0 }; i < count; ++i) {
+            const uchar* b{ backward + static_cast<std::size_t>(i) * stride };
+            const uchar* f{ forward + static_cast<std::size_t>(i + window - 1) * stride };
+            uchar* o{ out + i * out_step };
+            if (accumulate) {
+                for (int k{ 0 }; k < stride; ++k) {
+                    o[k] = op<Erode>(o[k], op<Erode>(b[k], f[k]));
+                }
+            }
+            else {
+                for (int k{ 0 }; k < stride; ++k) {
+                    o[k] = op<Erode>(b[k], f[k]);
+                }
+            }
+        }
+    }
+
+    template <bool Erode>
+    void horizontalPass(const cv::Mat& src, cv::Mat& dst, int x0, int x1) const {
+        dst.create(src.size(), src.type());
+        const int cn{ src.channels() };
+        const int window{ x1 - x0 + 1 };
+        const int len{ src.cols + window - 1 };
+
+        std::vector<int> bands((src.rows + band_rows_ - 1) / band_rows_);
+        std::iota(bands.begin(), bands.end(), 0);
+        std::for_each(std::execution::par, bands.begin(), bands.end(), [&](int band) {
+            thread_local std::vector<uchar> padded, forward, backward;
+            padded.resize(static_cast<std::size_t>(len) * cn);
+            forward.resize(padded.size());
+            backward.resize(padded.size());
+
+            // Part of the row visible through the line, everything else is neutral
+            const int first{ std::clamp(x0, 0, src.cols) };
+            const int last{ std::clamp(src.cols + x1, 0, src.cols) };
+
+            const int end{ std::min((band + 1) * band_rows_, src.rows) };
+            for (int y{ band * band_rows_ }; y < end; ++y) {
+                std::fill(padded.begin(), padded.end(), neutral<Erode>());
+                if (last > first) {
+                    std::memcpy(padded.data() + static_cast<std::size_t>(first - x0) * cn, src.ptr<uchar>(y) + static_cast<std::size_t>(first) * cn,
+                        static_cast<std::size_t>(last - first) * cn);
+                }
+                lineFilter<Erode>(padded.data(), len, window, cn, forward.data(), backward.data(), dst.ptr<uchar>(y), cn, src.cols, false);
+            }
+            });
+    }
+
+    template <bool Erode>
+    void verticalPass(const cv::Mat& src, cv::Mat& dst, int y0, int y1, bool accumulate) const {
+        const int row_bytes{ src.cols * src.channels() };
+        const int window{ y1 - y0 + 1 };
+        const int len{ src.rows + window - 1 };
+
+        std::vector<int> strips((row_bytes + strip_bytes_ - 1) / strip_bytes_);
+        std::iota(strips.begin(), strips.end(), 0);
+        std::for_each(std::execution::par, strips.begin(), strips.end(), [&](int strip) {
+            const int begin{ strip * strip_bytes_ };
+            const int width{ std::min(strip_bytes_, row_bytes - begin) };
+
+            thread_local std::vector<uchar> padded, forward, backward;
+            padded.resize(static_cast<std::size_t>(len) * width);
+            forward.resize(padded.size());
+            backward.resize(padded.size());
+
+            // Strip of columns stored row after row, rows outside of the image are neutral
+            for (int i{ 0 }; i < len; ++i) {
+                uchar* p{ padded.data() + static_cast<std::size_t>(i) * width };
+                const int y{ i + y0 };
+                if (y >= 0 && y < src.rows) {
+                    std::memcpy(p, src.ptr<uchar>(y) + begin, width);
+                }
+                else {
+                    std::fill(p, p + width, neutral<Erode>());
+                }
+            }
+            lineFilter<Erode>(padded.data(), len, window, width, forward.data(), backward.data(), dst.ptr<uchar>(0) + begin, dst.step,
+                src.rows, accumulate);
+            });
+    }
+};
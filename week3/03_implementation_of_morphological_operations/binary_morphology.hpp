@@ -0,0 +1,313 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <stdexcept>
+#include <format>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <utility>
+#include <cstdlib>
+
+/// <summary>
+/// Binary mask packed 64 pixels per word, bit b of word w is pixel 64 * w + b.
+/// Every row has pad words on both sides and bits after the last column, all of them hold the fill value,
+/// so shifted reads near borders see the same value as the default border of cv::erode/cv::dilate.
+/// </summary>
+class PackedMask {
+public:
+    PackedMask() = default;
+
+    PackedMask(int rows, int cols, int pad, bool fill)
+        : rows_(rows), cols_(cols), words_((cols + 63) / 64), pad_(pad), stride_(words_ + 2 * pad),
+        data_(static_cast<std::size_t>(rows) * stride_, fill ? ~std::uint64_t{ 0 } : 0), fill_(fill) {}
+
+    /// <summary>
+    /// Packs CV_8U mask, every non-zero pixel is foreground
+    /// </summary>
+    static PackedMask pack(const cv::Mat& mask, int pad, bool fill) {
+        if (mask.empty() || mask.type() != CV_8U) {
+            throw std::runtime_error("Binary morphology works only with single channel 8-bit masks!\n");
+        }
+        PackedMask packed(mask.rows, mask.cols, pad, fill);
+        std::vector<int> rows(mask.rows);
+        std::iota(rows.begin(), rows.end(), 0);
+        std::for_each(std::execution::par, rows.begin(), rows.end(), [&](int y) {
+            const uchar* src{ mask.ptr<uchar>(y) };
+            std::uint64_t* dst{ packed.row(y) };
+            for (int w{ 0 }; w < packed.words_; ++w) {
+                const int begin{ w * 64 };
+                const int count{ std::min(64, mask.cols - begin) };
+                std::uint64_t word{ 0 };
+                for (int b{ 0 }; b < count; ++b) {
+                    word |= static_cast<std::uint64_t>(src[begin + b] != 0) << b;
+                }
+                dst[w] = word;
+            }
+            packed.fixTail(y);
+            });
+        return packed;
+    }
+
+    /// <summary>
+    /// Writes CV_8U mask with foreground pixels set to given value and background to 0
+    /// </summary>
+    void unpack(cv::Mat& dst, uchar foreground = 255) const {
+        dst.create(rows_, cols_, CV_8U);
+        std::vector<int> rows(rows_);
+        std::iota(rows.begin(), rows.end(), 0);
+        std::for_each(std::execution::par, rows.begin(), rows.end(), [&](int y) {
+            const std::uint64_t* src{ row(y) };
+            uchar* out{ dst.ptr<uchar>(y) };
+            for (int x{ 0 }; x < cols_; ++x) {
+                out[x] = (src[x >> 6] >> (x & 63)) & 1 ? foreground : 0;
+            }
+            });
+    }
+
+    /// <summary>
+    /// Sets padding words and bits after the last column to a new fill value, needed when erosion follows dilation
+    /// </summary>
+    void refill(bool fill) {
+        fill_ = fill;
+        const std::uint64_t word{ fillWord() };
+        for (int y{ 0 }; y < rows_; ++y) {
+            std::uint64_t* r{ row(y) };
+            std::fill(r - pad_, r, word);
+            std::fill(r + words_, r + words_ + pad_, word);
+            fixTail(y);
+        }
+    }
+
+    /// <summary>
+    /// Pointer to the first pixel word of a row, indices from -pad to words + pad - 1 are valid
+    /// </summary>
+    std::uint64_t* row(int y) {
+        return data_.data() + static_cast<std::size_t>(y) * stride_ + pad_;
+    }
+
+    const std::uint64_t* row(int y) const {
+        return data_.data() + static_cast<std::size_t>(y) * stride_ + pad_;
+    }
+
+    /// <summary>
+    /// Bits after the last column get the fill value
+    /// </summary>
+    void fixTail(int y) {
+        if (cols_ % 64 == 0) {
+            return;
+        }
+        const std::uint64_t tail{ ~std::uint64_t{ 0 } << (cols_ % 64) };
+        std::uint64_t& last{ row(y)[words_ - 1] };
+        last = fill_ ? last | tail : last & ~tail;
+    }
+
+    std::uint64_t fillWord() const {
+        return fill_ ? ~std::uint64_t{ 0 } : 0;
+    }
+
+    int getRows() const {
+        return rows_;
+    }
+
+    int getCols() const {
+        return cols_;
+    }
+
+    int getWords() const {
+        return words_;
+    }
+
+    int getPad() const {
+        return pad_;
+    }
+
+private:
+    int rows_{ 0 };
+    int cols_{ 0 };
+    int words_{ 0 };
+    int pad_{ 0 };
+    int stride_{ 0 };
+    std::vector<std::uint64_t> data_;
+    bool fill_{ false };
+};
+
+/// <summary>
+/// Dilation and erosion of binary masks with an arbitrary structuring element, 64 pixels per machine word.
+/// Every row of the element is split into runs of non-zero values. A run of length L is computed once per source row
+/// with log2(L) shift-OR (shift-AND for erosion) steps, after that every output row combines one precomputed row per run
+/// of the element. Both stages run in parallel over bands of rows.
+/// Results are identical to cv::dilate/cv::erode with the default border.
+/// </summary>
+class BinaryMorphology {
+public:
+    BinaryMorphology(const cv::Mat& element, cv::Point anchor = { -1, -1 }, int band_rows = 16) : band_rows_(std::max(band_rows, 1)) {
+        if (element.empty() || element.type() != CV_8U) {
+            throw std::runtime_error("Structuring element must be a non-empty CV_8U matrix!\n");
+        }
+        anchor = { anchor.x < 0 ? element.cols / 2 : anchor.x, anchor.y < 0 ? element.rows / 2 : anchor.y };
+
+        int reach{ 0 };
+        for (int y{ 0 }; y < element.rows; ++y) {
+            const uchar* row{ element.ptr<uchar>(y) };
+            for (int x{ 0 }; x < element.cols; ++x) {
+                if (!row[x] || (x > 0 && row[x - 1])) {
+                    continue;
+                }
+                int end{ x };
+                while (end < element.cols && row[end]) {
+                    ++end;
+                }
+
+                Run run{ x - anchor.x, end - x };
+                auto found{ std::ranges::find_if(runs_, [&run](const Run& r) { return r.offset == run.offset && r.length == run.length; }) };
+                std::size_t index{ static_cast<std::size_t>(found - runs_.begin()) };
+                if (found == runs_.end()) {
+                    runs_.push_back(run);
+                }
+                entries_.emplace_back(y - anchor.y, index);
+                reach = std::max({ reach, std::abs(run.offset), std::abs(run.offset + run.length - 1) + run.length });
+            }
+        }
+
+        if (runs_.empty()) {
+            throw std::runtime_error("Structuring element has no non-zero values!\n");
+        }
+
+        // Shifted reads of every run and every doubling step stay inside the padding
+        pad_ = reach / 64 + 2;
+    }
+
+    void dilate(const cv::Mat& src, cv::Mat& dst, int iterations = 1, uchar foreground = 255) const {
+        morphologyEx(src, dst, cv::MORPH_DILATE, iterations, foreground);
+    }
+
+    void erode(const cv::Mat& src, cv::Mat& dst, int iterations = 1, uchar foreground = 255) const {
+        morphologyEx(src, dst, cv::MORPH_ERODE, iterations, foreground);
+    }
+
+    /// <summary>
+    /// Supports MORPH_ERODE, MORPH_DILATE, MORPH_OPEN and MORPH_CLOSE, the mask stays packed between the steps
+    /// </summary>
+    void morphologyEx(const cv::Mat& src, cv::Mat& dst, int op, int iterations = 1, uchar foreground = 255) const {
+        iterations = std::max(iterations, 0);
+        std::vector<bool> steps;
+        if (op == cv::MORPH_DILATE || op == cv::MORPH_CLOSE) {
+            steps.insert(steps.end(), iterations, true);
+        }
+        if (op == cv::MORPH_ERODE || op == cv::MORPH_OPEN || op == cv::MORPH_CLOSE) {
+            steps.insert(steps.end(), iterations, false);
+        }
+        if (op == cv::MORPH_OPEN) {
+            steps.insert(steps.end(), iterations, true);
+        }
+        if (op != cv::MORPH_DILATE && op != cv::MORPH_ERODE && op != cv::MORPH_OPEN && op != cv::MORPH_CLOSE) {
+            throw std::runtime_error(std::format("Unsupported binary morphology operation: {}\n", op));
+        }
+
+        PackedMask current{ PackedMask::pack(src, pad_, steps.empty() || !steps.front()) };
+        PackedMask next(current.getRows(), current.getCols(), pad_, false);
+        for (bool dilation : steps) {
+            current.refill(!dilation);
+            pass(current, next, dilation);
+            std::swap(current, next);
+        }
+        current.unpack(dst, foreground);
+    }
+
+private:
+    /// <summary>
+    /// Horizontal run of the structuring element, offset is relative to the anchor
+    /// </summary>
+    struct Run {
+        int offset;
+        int length;
+    };
+
+    std::vector<Run> runs_;
+    // Vertical offset of an element row and index of its run
+    std::vector<std::pair<int, std::size_t>> entries_;
+    int pad_{ 0 };
+    int band_rows_;
+
+    /// <summary>
+    /// Word i of a row shifted so that pixel x holds pixel x + offset, words outside of the buffer are fill
+    /// </summary>
+    static std::uint64_t shifted(const std::uint64_t* row, int i, int offset, int begin, int end, std::uint64_t fill) {
+        const int q{ offset >> 6 };
+        const int r{ offset & 63 };
+        auto at = [&](int index) { return index >= begin && index < end ? row[index] : fill; };
+        if (r == 0) {
+            return at(i + q);
+        }
+        return (at(i + q) >> r) | (at(i + q + 1) << (64 - r));
+    }
+
+    static std::uint64_t combine(std::uint64_t a, std::uint64_t b, bool dilation) {
+        return dilation ? a | b : a & b;
+    }
+
+    void pass(const PackedMask& src, PackedMask& dst, bool dilation) const {
+        const int rows{ src.getRows() };
+        const int words{ src.getWords() };
+        const int begin{ -pad_ };
+        const int end{ words + pad_ };
+        const int stride{ end - begin };
+        const std::uint64_t fill{ src.fillWord() };
+
+        std::vector<int> bands((rows + band_rows_ - 1) / band_rows_);
+        std::iota(bands.begin(), bands.end(), 0);
+
+        // 1. Every source row combined with every distinct run of the element
+        std::vector<std::vector<std::uint64_t>> horizontal(runs_.size(), std::vector<std::uint64_t>(static_cast<std::size_t>(rows) * stride));
+        std::for_each(std::execution::par, bands.begin(), bands.end(), [&](int band) {
+            thread_local std::vector<std::uint64_t> span;
+            span.resize(stride);
+
+            const int last{ std::min((band + 1) * band_rows_, rows) };
+            for (int y{ band * band_rows_ }; y < last; ++y) {
+                const std::uint64_t* row{ src.row(y) };
+                for (std::size_t r{ 0 }; r < runs_.size(); ++r) {
+                    // span[x] covers pixels x..x + covered - 1, doubled until it covers the whole run
+                    std::uint64_t* s{ span.data() - begin };
+                    std::copy(row + begin, row + end, s + begin);
+                    for (int covered{ 1 }; covered < runs_[r].length;) {
+                        const int step{ std::min(covered, runs_[r].length - covered) };
+                        // Reads are ahead of writes, so the update can be done in place
+                        for (int i{ begin }; i < end; ++i) {
+                            s[i] = combine(s[i], shifted(s, i, step, begin, end, fill), dilation);
+                        }
+                        covered += step;
+                    }
+
+                    std::uint64_t* out{ horizontal[r].data() + static_cast<std::size_t>(y) * stride - begin };
+                    for (int i{ 0 }; i < words; ++i) {
+                        out[i] = shifted(s, i, runs_[r].offset, begin, end, fill);
+                    }
+                }
+            }
+            });
+
+        // 2. Every output row combines rows of the element, rows outside of the mask don't change the result
+        std::for_each(std::execution::par, bands.begin(), bands.end(), [&](int band) {
+            const int last{ std::min((band + 1) * band_rows_, rows) };
+            for (int y{ band * band_rows_ }; y < last; ++y) {
+                std::uint64_t* out{ dst.row(y) };
+                std::fill(out, out + words, dilation ? 0 : ~std::uint64_t{ 0 });
+                for (const auto& [dy, r] : entries_) {
+                    const int sy{ y + dy };
+                    if (sy < 0 || sy >= rows) {
+                        continue;
+                    }
+                    const std::uint64_t* h{ horizontal[r].data() + static_cast<std::size_t>(sy) * stride - begin };
+                    for (int i{ 0 }; i < words; ++i) {
+                        out[i] = combine(out[i], h[i], dilation);
+                    }
+                }
+            }
+            });
+    }
+};
@@ -2,6 +2,56 @@
 #include <opencv2/opencv.hpp>
 #include <iostream>
 #include <stdexcept>
+#include <print>
+#include <array>
+#include <tuple>
+#include <string>
+#include "binary_morphology.hpp"
+#include "../../common/timing.hpp"
+
+/// <summary>
+/// Compares packed binary morphology with cv::dilate and cv::erode on a large random mask
+/// </summary>
+void benchmark() {
+    constexpr int repetitions{ 5 };
+    cv::Mat noise(4096, 4096, CV_8U);
+    cv::randu(noise, 0, 256);
+    cv::Mat mask;
+    cv::threshold(noise, mask, 200, 255, cv::THRESH_BINARY);
+
+    const std::array<std::tuple<int, int, std::string>, 5> elements{ {
+        { cv::MORPH_CROSS, 3, "cross" }, { cv::MORPH_RECT, 3, "rect" }, { cv::MORPH_ELLIPSE, 7, "ellipse" },
+        { cv::MORPH_RECT, 23, "rect" }, { cv::MORPH_ELLIPSE, 23, "ellipse" } } };
+
+    std::println("{}x{} mask", mask.cols, mask.rows);
+    std::println("{:>8} {:>5} {:>10} {:>12} {:>12} {:>8} {:>6}", "shape", "size", "operation", "cv [ms]", "packed [ms]", "speedup", "same");
+    for (const auto& [shape, size, name] : elements) {
+        auto element{ cv::getStructuringElement(shape, cv::Size(size, size)) };
+        BinaryMorphology morphology{ element };
+        for (bool dilation : { true, false }) {
+            cv::Mat reference, result;
+            double cv_ms{ measureMs([&] {
+                if (dilation) {
+                    cv::dilate(mask, reference, element);
+                }
+                else {
+                    cv::erode(mask, reference, element);
+                }
+                }, repetitions) };
+            double packed_ms{ measureMs([&] {
+                if (dilation) {
+                    morphology.dilate(mask, result);
+                }
+                else {
+                    morphology.erode(mask, result);
+                }
+                }, repetitions) };
+            bool same{ cv::norm(reference, result, cv::NORM_INF) == 0 };
+            std::println("{:>8} {:>5} {:>10} {:>12.3f} {:>12.3f} {:>8.2f} {:>6}", name, size, dilation ? "dilate" : "erode",
+                cv_ms, packed_ms, packed_ms > 0 ? cv_ms / packed_ms : 0.0, same);
+        }
+    }
+}
 
 int main() {
     // Create an empty (fill with 0) image, single channel with 10x10 size. 
@@ -23,36 +73,14 @@ int main() {
     std::cout << element;
     std::cout << "\n\n";
 
-    // Get info about size of th kernel - just one dimension, because structuring element has NxN shape
-    auto ksize{ element.size().height };
-
-    // Get size of the image
-    auto [width, height] = demo.size();
-    std::cout << width << ", " << height << "\n\n";
-
-    // Set value of border
-    int border{ ksize / 2 };
-
-    cv::Mat paddle_demo{ cv::Mat::zeros(cv::Size(height + border * 2, width + border * 2), CV_8U) };
-    cv::Mat bit_or;
-
-    for (int h_i = border; h_i < height + border; h_i++) {
-        for (int w_i = border; w_i < width + border; w_i++) {
-          if (demo.at<uchar>(h_i - border, w_i - border)) {
-              cv::bitwise_or(paddle_demo(
-                  cv::Range(h_i - border, h_i + border + 1), cv::Range(w_i - border, w_i + border + 1)),
-                  element, 
-                  bit_or);
-              bit_or.copyTo(paddle_demo(
-                  cv::Range(h_i - border, h_i + border + 1), 
-                  cv::Range(w_i - border, w_i + border + 1)));
-          }
-        }
-    }
+    // Dilation on a mask packed 64 pixels per word, the demo mask holds 0 and 1
+    BinaryMorphology morphology{ element };
+    cv::Mat dilated_image;
+    morphology.dilate(demo, dilated_image, 1, 1);
+    std::cout << dilated_image;
+    std::cout << "\n\n";
 
-    cv::Mat dilated_image = paddle_demo(
-        cv::Range(border, border + height), 
-        cv::Range(border, border + width));
+    benchmark();
 
     std::string blobs{ "Blobs" };
     cv::namedWindow(blobs, cv::WINDOW_NORMAL);
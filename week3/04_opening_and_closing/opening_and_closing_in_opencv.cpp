@@ -2,6 +2,7 @@
 #include <opencv2/opencv.hpp>
 #include <iostream>
 #include <stdexcept>
+#include "../02_erosion_and_dilation/morphology_engine.hpp"
 
 int main() {
     // Path to an image 
@@ -31,33 +32,36 @@ int main() {
         cv::Size(2 * kernel_size + 1, 2 * kernel_size + 1),
         cv::Point(kernel_size, kernel_size)) };
 
+    // Kernel size doesn't change the cost of the engine
+    MorphologyEngine engine;
+
     // 1. Wipe out small white blobs
 
     // Perform erosion
     cv::Mat eroded;
-    cv::erode(opening, eroded, element);
+    engine.erode(opening, eroded, element);
 
     // Perform dilation on eroded image
     cv::Mat eroded_dilated;
-    cv::dilate(eroded, eroded_dilated, element);
+    engine.dilate(eroded, eroded_dilated, element);
 
     // Perform opening
     cv::Mat opened;
-    cv::morphologyEx(opening, opened, cv::MORPH_OPEN, element);
+    engine.morphologyEx(opening, opened, cv::MORPH_OPEN, element);
 
     // 2. Wipe out small black blobs
 
     // Perform dilatation
     cv::Mat dilated;
-    cv::dilate(closing, dilated, element);
+    engine.dilate(closing, dilated, element);
 
     // Perform erosion on dilated image
     cv::Mat dilated_eroded;
-    cv::erode(dilated, dilated_eroded, element);
+    engine.erode(dilated, dilated_eroded, element);
 
     // Perform closing
     cv::Mat closed;
-    cv::morphologyEx(closing, closed, cv::MORPH_CLOSE, element);
+    engine.morphologyEx(closing, closed, cv::MORPH_CLOSE, element);
 
 
     cv::imshow("Original Opening", opening);
@@ -0,0 +1,370 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <stdexcept>
+#include <format>
+#include <vector>
+#include <span>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <limits>
+
+/// <summary>
+/// Horizontal run of foreground pixels [start, end) in a row
+/// </summary>
+struct Run {
+    int row;
+    int start;
+    int end;
+};
+
+/// <summary>
+/// Statistics of a single connected component
+/// </summary>
+struct ComponentStats {
+    int label{ 0 };
+    int area{ 0 };
+    cv::Rect bbox;
+    cv::Point2d centroid;
+    // Same values as cv::moments of the component mask
+    cv::Moments moments;
+};
+
+/// <summary>
+/// Raw moments up to the third order and bounding box, accumulated run by run in closed form
+/// </summary>
+struct MomentSums {
+    double m00{ 0 }, m10{ 0 }, m01{ 0 }, m20{ 0 }, m11{ 0 }, m02{ 0 }, m30{ 0 }, m21{ 0 }, m12{ 0 }, m03{ 0 };
+    int left{ std::numeric_limits<int>::max() };
+    int top{ std::numeric_limits<int>::max() };
+    int right{ std::numeric_limits<int>::min() };
+    int bottom{ std::numeric_limits<int>::min() };
+
+    void add(const Run& run) {
+        // Sums of x, x^2 and x^3 over [start, end - 1] from sums over [0, n]
+        auto sum1 = [](double n) { return n * (n + 1) / 2; };
+        auto sum2 = [](double n) { return n * (n + 1) * (2 * n + 1) / 6; };
+        auto sum3 = [&sum1](double n) { return sum1(n) * sum1(n); };
+        const double first{ static_cast<double>(run.start) - 1 };
+        const double last{ static_cast<double>(run.end) - 1 };
+        const double n{ static_cast<double>(run.end - run.start) };
+        const double y{ static_cast<double>(run.row) };
+        const double sx{ sum1(last) - sum1(first) };
+        const double sx2{ sum2(last) - sum2(first) };
+        const double sx3{ sum3(last) - sum3(first) };
+
+        m00 += n;
+        m10 += sx;
+        m01 += n * y;
+        m20 += sx2;
+        m11 += sx * y;
+        m02 += n * y * y;
+        m30 += sx3;
+        m21 += sx2 * y;
+        m12 += sx * y * y;
+        m03 += n * y * y * y;
+
+        left = std::min(left, run.start);
+        right = std::max(right, run.end - 1);
+        top = std::min(top, run.row);
+        bottom = std::max(bottom, run.row);
+    }
+
+    void merge(const MomentSums& other) {
+        m00 += other.m00;
+        m10 += other.m10;
+        m01 += other.m01;
+        m20 += other.m20;
+        m11 += other.m11;
+        m02 += other.m02;
+        m30 += other.m30;
+        m21 += other.m21;
+        m12 += other.m12;
+        m03 += other.m03;
+        left = std::min(left, other.left);
+        right = std::max(right, other.right);
+        top = std::min(top, other.top);
+        bottom = std::max(bottom, other.bottom);
+    }
+
+    ComponentStats toStats(int label) const {
+        ComponentStats stats;
+        stats.label = label;
+        stats.area = static_cast<int>(m00);
+        stats.bbox = { left, top, right - left + 1, bottom - top + 1 };
+        stats.centroid = { m10 / m00, m01 / m00 };
+        stats.moments = cv::Moments(m00, m10, m01, m20, m11, m02, m30, m21, m12, m03);
+        return stats;
+    }
+};
+
+/// <summary>
+/// Returns true if runs from neighbouring rows touch each other
+/// </summary>
+inline bool runsTouch(const Run& a, const Run& b, int connectivity) {
+    return connectivity == 8 ? a.start <= b.end && b.start <= a.end : a.start < b.end && b.start < a.end;
+}
+
+/// <summary>
+/// Connected components of a binary image labelled on runs instead of pixels.
+/// The image is split into strips of rows labelled in parallel, every strip extracts its runs, joins them with
+/// a union-find and accumulates statistics of its partial components. Strips are then joined along their borders
+/// and partial statistics are merged, so pixels are read only once. Labels follow raster order of the first pixel
+/// of every component, 0 is the background. Runs of every component are stored together, so a cropped mask or the
+/// list of runs of a component costs only its own area.
+/// </summary>
+class ComponentAnalysis {
+public:
+    ComponentAnalysis(int connectivity = 8, int strip_rows = 64) : connectivity_(connectivity), strip_rows_(std::max(strip_rows, 1)) {
+        if (connectivity != 4 && connectivity != 8) {
+            throw std::runtime_error(std::format("Connectivity must be 4 or 8, got {}\n", connectivity));
+        }
+    }
+
+    /// <summary>
+    /// Labels non-zero pixels of a CV_8U image
+    /// </summary>
+    /// <returns>Number of labels including background, same as cv::connectedComponents</returns>
+    int process(const cv::Mat& binary) {
+        if (binary.empty() || binary.type() != CV_8U) {
+            throw std::runtime_error("Component analysis works only with single channel 8-bit images!\n");
+        }
+        size_ = binary.size();
+
+        // 1. Runs, local union-find and partial statistics of every strip
+        std::vector<Strip> strips((binary.rows + strip_rows_ - 1) / strip_rows_);
+        std::vector<int> indices(strips.size());
+        std::iota(indices.begin(), indices.end(), 0);
+        std::for_each(std::execution::par, indices.begin(), indices.end(), [&](int s) {
+            labelStrip(binary, s * strip_rows_, std::min((s + 1) * strip_rows_, binary.rows), strips[s]);
+            });
+
+        // 2. Global union-find over runs, roots are always the first run of a set in raster order
+        std::size_t total{ 0 };
+        std::vector<std::size_t> offsets(strips.size());
+        for (std::size_t s{ 0 }; s < strips.size(); ++s) {
+            offsets[s] = total;
+            total += strips[s].runs.size();
+        }
+        std::vector<std::size_t> parent(total);
+        std::vector<Run> runs(total);
+        for (std::size_t s{ 0 }; s < strips.size(); ++s) {
+            for (std::size_t i{ 0 }; i < strips[s].runs.size(); ++i) {
+                runs[offsets[s] + i] = strips[s].runs[i];
+                parent[offsets[s] + i] = offsets[s] + strips[s].parent[i];
+            }
+        }
+
+        // 3. Join runs along the borders of strips
+        for (std::size_t s{ 1 }; s < strips.size(); ++s) {
+            const auto& upper{ strips[s - 1] };
+            const auto& lower{ strips[s] };
+            std::size_t a{ upper.last_row_begin };
+            std::size_t b{ 0 };
+            while (a < upper.runs.size() && b < lower.first_row_end) {
+                if (runsTouch(upper.runs[a], lower.runs[b], connectivity_)) {
+                    unite(parent, offsets[s - 1] + a, offsets[s] + b);
+                }
+                // Move the run which ends first
+                if (upper.runs[a].end < lower.runs[b].end) {
+                    ++a;
+                }
+                else {
+                    ++b;
+                }
+            }
+        }
+
+        // 4. Final labels, parent of a run always precedes it
+        std::vector<int> run_labels(total);
+        int components{ 0 };
+        for (std::size_t i{ 0 }; i < total; ++i) {
+            parent[i] = parent[parent[i]];
+            run_labels[i] = parent[i] == i ? ++components : run_labels[parent[i]];
+        }
+
+        // 5. Partial statistics merged into components
+        std::vector<MomentSums> sums(components);
+        for (std::size_t s{ 0 }; s < strips.size(); ++s) {
+            for (std::size_t c{ 0 }; c < strips[s].sums.size(); ++c) {
+                sums[run_labels[offsets[s] + strips[s].roots[c]] - 1].merge(strips[s].sums[c]);
+            }
+        }
+        stats_.resize(components);
+        for (int c{ 0 }; c < components; ++c) {
+            stats_[c] = sums[c].toStats(c + 1);
+        }
+
+        // 6. Runs grouped by component, raster order inside every component
+        run_offsets_.assign(components + 2, 0);
+        for (int label : run_labels) {
+            ++run_offsets_[label + 1];
+        }
+        std::partial_sum(run_offsets_.begin(), run_offsets_.end(), run_offsets_.begin());
+        runs_.resize(total);
+        std::vector<std::size_t> position(run_offsets_.begin(), run_offsets_.end() - 1);
+        for (std::size_t i{ 0 }; i < total; ++i) {
+            runs_[position[run_labels[i]]++] = runs[i];
+        }
+
+        return components + 1;
+    }
+
+    int getComponentCount() const {
+        return static_cast<int>(stats_.size());
+    }
+
+    /// <summary>
+    /// Statistics of components, element i describes label i + 1
+    /// </summary>
+    const std::vector<ComponentStats>& getStats() const {
+        return stats_;
+    }
+
+    /// <summary>
+    /// Runs of a component in raster order
+    /// </summary>
+    std::span<const Run> getRuns(int label) const {
+        checkLabel(label);
+        return { runs_.data() + run_offsets_[label], run_offsets_[label + 1] - run_offsets_[label] };
+    }
+
+    /// <summary>
+    /// CV_8U mask of a component cropped to its bounding box, use getStats()[label - 1].bbox to place it in the image
+    /// </summary>
+    cv::Mat getMask(int label, uchar foreground = 255) const {
+        checkLabel(label);
+        const auto& bbox{ stats_[label - 1].bbox };
+        cv::Mat mask{ cv::Mat::zeros(bbox.size(), CV_8U) };
+        for (const auto& run : getRuns(label)) {
+            uchar* row{ mask.ptr<uchar>(run.row - bbox.y) };
+            std::fill(row + run.start - bbox.x, row + run.end - bbox.x, foreground);
+        }
+        return mask;
+    }
+
+    /// <summary>
+    /// Full CV_32S label image, the same layout as cv::connectedComponents
+    /// </summary>
+    void getLabels(cv::Mat& labels) const {
+        labels.create(size_, CV_32S);
+        labels.setTo(0);
+        std::vector<int> components(stats_.size());
+        std::iota(components.begin(), components.end(), 1);
+        // Components never share pixels, so they can be painted in parallel
+        std::for_each(std::execution::par, components.begin(), components.end(), [&](int label) {
+            for (const auto& run : getRuns(label)) {
+                int* row{ labels.ptr<int>(run.row) };
+                std::fill(row + run.start, row + run.end, label);
+            }
+            });
+    }
+
+private:
+    /// <summary>
+    /// Result of labelling one strip, parent indices are local to the strip
+    /// </summary>
+    struct Strip {
+        std::vector<Run> runs;
+        std::vector<std::size_t> parent;
+        // Partial components and index of their first run
+        std::vector<MomentSums> sums;
+        std::vector<std::size_t> roots;
+        std::size_t first_row_end{ 0 };
+        std::size_t last_row_begin{ 0 };
+    };
+
+    int connectivity_;
+    int strip_rows_;
+    cv::Size size_;
+    std::vector<ComponentStats> stats_;
+    std::vector<Run> runs_;
+    std::vector<std::size_t> run_offsets_;
+
+    void checkLabel(int label) const {
+        if (label < 1 || label > getComponentCount()) {
+            throw std::runtime_error(std::format("Label {} is out of range [1, {}]\n", label, getComponentCount()));
+        }
+    }
+
+    static std::size_t find(std::vector<std::size_t>& parent, std::size_t i) {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+
+    /// <summary>
+    /// Joins two sets, the smaller index becomes the root
+    /// </summary>
+    static void unite(std::vector<std::size_t>& parent, std::size_t a, std::size_t b) {
+        a = find(parent, a);
+        b = find(parent, b);
+        if (a < b) {
+            parent[b] = a;
+        }
+        else if (b < a) {
+            parent[a] = b;
+        }
+    }
+
+    void labelStrip(const cv::Mat& binary, int begin, int end, Strip& strip) const {
+        std::size_t previous_begin{ 0 };
+        std::size_t previous_end{ 0 };
+        for (int y{ begin }; y < end; ++y) {
+            const uchar* row{ binary.ptr<uchar>(y) };
+            const std::size_t current_begin{ strip.runs.size() };
+            strip.last_row_begin = current_begin;
+
+            for (int x{ 0 }; x < binary.cols;) {
+                if (!row[x]) {
+                    ++x;
+                    continue;
+                }
+                int start{ x };
+                while (x < binary.cols && row[x]) {
+                    ++x;
+                }
+                const std::size_t index{ strip.runs.size() };
+                strip.runs.push_back({ y, start, x });
+                strip.parent.push_back(index);
+
+                // Runs of the previous row are sorted, those ending left of this run can't touch any later run either
+                const Run& run{ strip.runs.back() };
+                const int min_end{ connectivity_ == 8 ? run.start : run.start + 1 };
+                while (previous_begin < previous_end && strip.runs[previous_begin].end < min_end) {
+                    ++previous_begin;
+                }
+                for (std::size_t p{ previous_begin }; p < previous_end && strip.runs[p].start <= run.end; ++p) {
+                    if (runsTouch(strip.runs[p], run, connectivity_)) {
+                        unite(strip.parent, p, index);
+                    }
+                }
+            }
+
+            if (y == begin) {
+                strip.first_row_end = strip.runs.size();
+            }
+            previous_begin = current_begin;
+            previous_end = strip.runs.size();
+        }
+
+        // Flatten local sets and accumulate statistics of partial components
+        std::vector<std::size_t> component(strip.runs.size());
+        for (std::size_t i{ 0 }; i < strip.runs.size(); ++i) {
+            strip.parent[i] = strip.parent[strip.parent[i]];
+            if (strip.parent[i] == i) {
+                component[i] = strip.sums.size();
+                strip.sums.emplace_back();
+                strip.roots.push_back(i);
+            }
+            else {
+                component[i] = component[strip.parent[i]];
+            }
+            strip.sums[component[i]].add(strip.runs[i]);
+        }
+    }
+};
@@ -2,6 +2,9 @@
 #include <opencv2/opencv.hpp>
 #include <iostream>
 #include <stdexcept>
+#include <print>
+#include <chrono>
+#include "component_analysis.hpp"
 
 int main() {
     // Path to an image 
@@ -24,12 +27,31 @@ int main() {
     cv::Mat threshold;
     cv::threshold(grayscale, threshold, 127, 255, cv::THRESH_BINARY);
 
-    // Find connected components
-    cv::Mat labels;
-    auto n_components{ cv::connectedComponents(threshold, labels) };
+    // Find connected components with statistics in a single pass over the image
+    ComponentAnalysis analysis;
+    auto start{ std::chrono::steady_clock::now() };
+    auto n_components{ analysis.process(threshold) };
+    std::chrono::duration<double, std::milli> analysis_time{ std::chrono::steady_clock::now() - start };
+
+    // The same with OpenCV, every label needs its own full-size mask
+    cv::Mat cv_labels, cv_stats, cv_centroids;
+    start = std::chrono::steady_clock::now();
+    auto cv_components{ cv::connectedComponentsWithStats(threshold, cv_labels, cv_stats, cv_centroids) };
+    for (int i{ 1 }; i < cv_components; ++i) {
+        cv::Mat mask{ cv_labels == i };
+    }
+    std::chrono::duration<double, std::milli> cv_time{ std::chrono::steady_clock::now() - start };
+    std::println("Components: {} (OpenCV: {}), analysis {:.3f} ms, OpenCV with masks {:.3f} ms",
+        n_components - 1, cv_components - 1, analysis_time.count(), cv_time.count());
 
-    // Make a copy of connected components, because it is possible to show every label separately
-    auto labels_copy = labels.clone();
+    for (const auto& stats : analysis.getStats()) {
+        std::println("Label {}: area {}, bbox {}x{} at ({}, {}), centroid ({:.1f}, {:.1f}), runs {}", stats.label, stats.area,
+            stats.bbox.width, stats.bbox.height, stats.bbox.x, stats.bbox.y, stats.centroid.x, stats.centroid.y, analysis.getRuns(stats.label).size());
+    }
+
+    // Label image is needed only for visualization
+    cv::Mat labels;
+    analysis.getLabels(labels);
 
     // Normalize labels to [0, 255] range
     cv::normalize(labels, labels, 0, 255, cv::NORM_MINMAX);
@@ -43,9 +65,9 @@ int main() {
 
     cv::imshow("grayscale", grayscale);
     cv::imshow("connected components", labels);
-    for (int i{ 0 }; i < n_components; ++i) {
-        std::string name{ std::format("Label {}", i + 1) };
-        cv::imshow(name, labels_copy == i);
+    for (int i{ 1 }; i < n_components; ++i) {
+        std::string name{ std::format("Label {}", i) };
+        cv::imshow(name, analysis.getMask(i));
     }
     cv::imshow("Colormap", color_labels);
     cv::waitKey(0);
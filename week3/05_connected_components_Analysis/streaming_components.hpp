@@ -0,0 +1,228 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <stdexcept>
+#include <format>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <tuple>
+#include "component_analysis.hpp"
+
+/// <summary>
+/// Component emitted by StreamingComponents as soon as no later row can touch it
+/// </summary>
+struct StreamedComponent {
+    ComponentStats stats;
+    // Runs in raster order, empty if the labeller doesn't keep runs
+    std::vector<Run> runs;
+};
+
+/// <summary>
+/// Connected components of an image delivered as strips of rows, for images too tall to keep a label image.
+/// Only runs of the last row and open components are kept. Every run of a new row is joined with touching runs
+/// of the previous row through a union-find over component ids. A component without runs in the new row is closed,
+/// its statistics (and runs if requested) are emitted and its memory is released.
+/// Component id is the order of creation of its first run, so ids of emitted components grow in raster order
+/// of their first pixel but aren't consecutive.
+/// </summary>
+class StreamingComponents {
+public:
+    StreamingComponents(int connectivity = 8, bool keep_runs = false) : connectivity_(connectivity), keep_runs_(keep_runs) {
+        if (connectivity != 4 && connectivity != 8) {
+            throw std::runtime_error(std::format("Connectivity must be 4 or 8, got {}\n", connectivity));
+        }
+    }
+
+    /// <summary>
+    /// Labels next strip of a binary CV_8U image, every strip must have the same width
+    /// </summary>
+    /// <returns>Components closed by this strip</returns>
+    std::vector<StreamedComponent> push(const cv::Mat& strip) {
+        if (strip.empty() || strip.type() != CV_8U) {
+            throw std::runtime_error("Streaming components work only with single channel 8-bit strips!\n");
+        }
+        if (width_ >= 0 && strip.cols != width_) {
+            throw std::runtime_error(std::format("Strip width {} differs from {}\n", strip.cols, width_));
+        }
+        width_ = strip.cols;
+
+        std::vector<StreamedComponent> closed;
+        for (int y{ 0 }; y < strip.rows; ++y) {
+            processRow(strip.ptr<uchar>(y), closed);
+            ++row_;
+        }
+        return closed;
+    }
+
+    /// <summary>
+    /// Closes every component left at the bottom of the image
+    /// </summary>
+    std::vector<StreamedComponent> finish() {
+        std::vector<StreamedComponent> closed;
+        for (const auto& run : previous_) {
+            close(run.id, closed);
+        }
+        previous_.clear();
+        return closed;
+    }
+
+    std::size_t getOpenComponents() const {
+        return open_.size();
+    }
+
+    /// <summary>
+    /// Highest number of components open at the same time
+    /// </summary>
+    std::size_t getPeakOpenComponents() const {
+        return peak_open_;
+    }
+
+    /// <summary>
+    /// Highest number of runs kept at the same time, the last row and runs of open components
+    /// </summary>
+    std::size_t getPeakRuns() const {
+        return peak_runs_;
+    }
+
+    int getRows() const {
+        return row_;
+    }
+
+private:
+    struct LabelledRun {
+        Run run;
+        int id;
+    };
+
+    struct OpenComponent {
+        MomentSums sums;
+        std::vector<Run> runs;
+    };
+
+    int connectivity_;
+    bool keep_runs_;
+    int width_{ -1 };
+    int row_{ 0 };
+    int next_id_{ 1 };
+
+    std::vector<LabelledRun> previous_;
+    std::vector<LabelledRun> current_;
+    std::unordered_map<int, OpenComponent> open_;
+    // Union-find of a single row, cleared after every row
+    std::unordered_map<int, int> parent_;
+
+    std::size_t stored_runs_{ 0 };
+    std::size_t peak_open_{ 0 };
+    std::size_t peak_runs_{ 0 };
+
+    int find(int id) {
+        auto it{ parent_.find(id) };
+        while (it != parent_.end() && it->second != id) {
+            id = it->second;
+            it = parent_.find(id);
+        }
+        return id;
+    }
+
+    /// <summary>
+    /// Joins two open components, the older one survives and takes statistics and runs of the younger one
+    /// </summary>
+    int unite(int a, int b) {
+        a = find(a);
+        b = find(b);
+        if (a == b) {
+            return a;
+        }
+        if (b < a) {
+            std::swap(a, b);
+        }
+        auto younger{ open_.extract(b) };
+        auto& older{ open_.at(a) };
+        older.sums.merge(younger.mapped().sums);
+        older.runs.insert(older.runs.end(), younger.mapped().runs.begin(), younger.mapped().runs.end());
+        parent_[b] = a;
+        parent_[a] = a;
+        return a;
+    }
+
+    void close(int id, std::vector<StreamedComponent>& closed) {
+        auto node{ open_.extract(id) };
+        if (node.empty()) {
+            return;
+        }
+        auto& component{ node.mapped() };
+        stored_runs_ -= component.runs.size();
+        if (keep_runs_) {
+            // Runs of merged components were appended out of order
+            std::ranges::sort(component.runs, [](const Run& a, const Run& b) { return std::tie(a.row, a.start) < std::tie(b.row, b.start); });
+        }
+        closed.push_back({ component.sums.toStats(id), std::move(component.runs) });
+    }
+
+    void processRow(const uchar* row, std::vector<StreamedComponent>& closed) {
+        current_.clear();
+        parent_.clear();
+
+        std::size_t previous_begin{ 0 };
+        for (int x{ 0 }; x < width_;) {
+            if (!row[x]) {
+                ++x;
+                continue;
+            }
+            int start{ x };
+            while (x < width_ && row[x]) {
+                ++x;
+            }
+            Run run{ row_, start, x };
+
+            // Previous runs ending left of this run can't touch any later run either
+            const int min_end{ connectivity_ == 8 ? run.start : run.start + 1 };
+            while (previous_begin < previous_.size() && previous_[previous_begin].run.end < min_end) {
+                ++previous_begin;
+            }
+
+            int id{ 0 };
+            for (std::size_t p{ previous_begin }; p < previous_.size() && previous_[p].run.start <= run.end; ++p) {
+                if (runsTouch(previous_[p].run, run, connectivity_)) {
+                    id = id == 0 ? find(previous_[p].id) : unite(id, previous_[p].id);
+                }
+            }
+            if (id == 0) {
+                id = next_id_++;
+                open_.emplace(id, OpenComponent{});
+            }
+
+            auto& component{ open_.at(id) };
+            component.sums.add(run);
+            if (keep_runs_) {
+                component.runs.push_back(run);
+                ++stored_runs_;
+            }
+            current_.push_back({ run, id });
+        }
+
+        // Ids of the current row after all joins of this row
+        for (auto& labelled : current_) {
+            labelled.id = find(labelled.id);
+        }
+
+        // Components of the previous row which didn't reach this row are finished
+        std::vector<int> alive;
+        alive.reserve(current_.size());
+        for (const auto& labelled : current_) {
+            alive.push_back(labelled.id);
+        }
+        std::ranges::sort(alive);
+        for (const auto& labelled : previous_) {
+            int id{ find(labelled.id) };
+            if (!std::ranges::binary_search(alive, id)) {
+                close(id, closed);
+            }
+        }
+
+        std::swap(previous_, current_);
+        peak_open_ = std::max(peak_open_, open_.size());
+        peak_runs_ = std::max(peak_runs_, stored_runs_ + previous_.size());
+    }
+};
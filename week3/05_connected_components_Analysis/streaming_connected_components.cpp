@@ -0,0 +1,68 @@
+#include <opencv2/core.hpp>
+#include <opencv2/opencv.hpp>
+#include <iostream>
+#include <stdexcept>
+#include <print>
+#include <chrono>
+#include <string>
+#include "streaming_components.hpp"
+
+int main(int argc, char** argv) {
+    // Usage: streaming_connected_components [image] [strip rows] [repeats]
+    // Image is repeated vertically to simulate a long line-scan image which is never stored as a whole
+    std::string path{ argc > 1 ? argv[1] : "../data/images/truth.png" };
+    int strip_rows{ argc > 2 ? std::stoi(argv[2]) : 32 };
+    int repeats{ argc > 3 ? std::stoi(argv[3]) : 100 };
+
+    // Load an image
+    auto grayscale{ cv::imread(path, cv::IMREAD_GRAYSCALE) };
+
+    // Check if an image exists
+    try {
+        if (grayscale.empty()) {
+            throw std::runtime_error(std::format("Can't load an image from {}\n", path));
+        }
+        if (strip_rows <= 0 || repeats <= 0) {
+            throw std::runtime_error("Strip rows and repeats must be positive!\n");
+        }
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what();
+        return EXIT_FAILURE;
+    }
+
+    // Use threshold on the image
+    cv::Mat threshold;
+    cv::threshold(grayscale, threshold, 127, 255, cv::THRESH_BINARY);
+
+    StreamingComponents streaming;
+    std::size_t components{ 0 };
+    std::size_t area{ 0 };
+    auto consume = [&components, &area](const std::vector<StreamedComponent>& closed) {
+        for (const auto& component : closed) {
+            ++components;
+            area += component.stats.area;
+        }
+        };
+
+    auto start{ std::chrono::steady_clock::now() };
+    for (int r{ 0 }; r < repeats; ++r) {
+        for (int y{ 0 }; y < threshold.rows; y += strip_rows) {
+            consume(streaming.push(threshold.rowRange(y, std::min(y + strip_rows, threshold.rows))));
+        }
+    }
+    consume(streaming.finish());
+    std::chrono::duration<double, std::milli> elapsed{ std::chrono::steady_clock::now() - start };
+
+    std::println("Labelled {}x{} image in strips of {} rows: {} components, {} foreground pixels, {:.2f} ms",
+        threshold.cols, streaming.getRows(), strip_rows, components, area, elapsed.count());
+    std::println("Peak open components: {}, peak stored runs: {}", streaming.getPeakOpenComponents(), streaming.getPeakRuns());
+
+    // A single copy of the image labelled at once gives the same number of components per copy
+    ComponentAnalysis analysis;
+    auto per_image{ analysis.process(threshold) - 1 };
+    std::println("Components of one copy: {}, label image of the whole stream would take {:.1f} MB",
+        per_image, static_cast<double>(threshold.cols) * streaming.getRows() * sizeof(int) / (1024.0 * 1024.0));
+
+    return 0;
+}
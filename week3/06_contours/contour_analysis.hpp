@@ -0,0 +1,241 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <stdexcept>
+#include <format>
+#include <vector>
+#include <span>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+
+/// <summary>
+/// Contours of a retrieval mode: indices into ContourAnalysis and hierarchy expressed in positions of this view
+/// (next, previous, first child, parent), the same layout as hierarchy of cv::findContours
+/// </summary>
+struct ContourView {
+    std::vector<int> indices;
+    std::vector<cv::Vec4i> hierarchy;
+};
+
+/// <summary>
+/// Traces contours of an image once with RETR_TREE and derives RETR_LIST, RETR_EXTERNAL and RETR_CCOMP from the tree:
+///     - LIST - every contour without hierarchy
+///     - EXTERNAL - contours without parent
+///     - CCOMP - outer boundaries (even depth) at the top level, holes (odd depth) as children of their outer boundary
+/// Points of all contours are stored in a single arena, every contour is a span of it.
+/// Moments, area and perimeter are computed once for all contours in parallel.
+/// </summary>
+class ContourAnalysis {
+public:
+    /// <param name="img">Input image, must be 8-bit single-channel</param>
+    /// <param name="method">Contour approximation method. ( CHAIN_APPROX_NONE, CHAIN_APPROX_SIMPLE, CHAIN_APPROX_TC89_L1 etc)</param>
+    /// <param name="offset">Optional offset by which every contour point is shifted</param>
+    ContourAnalysis(const cv::Mat& img, int method = cv::CHAIN_APPROX_SIMPLE, cv::Point offset = cv::Point()) {
+        if (img.empty()) {
+            throw std::runtime_error("Empty image\n");
+        }
+
+        if (img.channels() != 1 or img.depth() != CV_8U) {
+            throw std::runtime_error("Wrong type of image. Must be 8-bit single channel");
+        }
+
+        std::vector<std::vector<cv::Point>> contours;
+        cv::findContours(img, contours, hierarchy_, cv::RETR_TREE, method, offset);
+
+        // Flat arena of points, nested vectors are released right after
+        std::size_t total{ 0 };
+        for (const auto& contour : contours) {
+            total += contour.size();
+        }
+        points_.reserve(total);
+        spans_.reserve(contours.size());
+        for (const auto& contour : contours) {
+            spans_.emplace_back(points_.size(), contour.size());
+            points_.insert(points_.end(), contour.begin(), contour.end());
+        }
+
+        depths_.assign(contours.size(), -1);
+        for (int i{ 0 }; i < size(); ++i) {
+            depth(i);
+        }
+
+        computeMeasures();
+    }
+
+    int size() const {
+        return static_cast<int>(spans_.size());
+    }
+
+    std::span<const cv::Point> getContour(int i) const {
+        const auto& [offset, count] = spans_.at(i);
+        return { points_.data() + offset, count };
+    }
+
+    /// <summary>
+    /// Hierarchy of RETR_TREE
+    /// </summary>
+    const std::vector<cv::Vec4i>& getHierarchy() const {
+        return hierarchy_;
+    }
+
+    /// <summary>
+    /// Nesting level, 0 for external contours, odd levels are holes
+    /// </summary>
+    int getDepth(int i) const {
+        return depths_.at(i);
+    }
+
+    const cv::Moments& getMoments(int i) const {
+        return moments_.at(i);
+    }
+
+    double getArea(int i) const {
+        return areas_.at(i);
+    }
+
+    double getPerimeter(int i) const {
+        return perimeters_.at(i);
+    }
+
+    /// <summary>
+    /// Contours and hierarchy of a retrieval mode derived from the tree
+    /// </summary>
+    ContourView view(int mode) const {
+        std::vector<int> indices;
+        std::vector<int> parents;
+        for (int i{ 0 }; i < size(); ++i) {
+            const int tree_parent{ hierarchy_[i][3] };
+            switch (mode) {
+            case cv::RETR_TREE:
+                indices.push_back(i);
+                parents.push_back(tree_parent);
+                break;
+            case cv::RETR_LIST:
+                indices.push_back(i);
+                parents.push_back(-1);
+                break;
+            case cv::RETR_EXTERNAL:
+                if (tree_parent < 0) {
+                    indices.push_back(i);
+                    parents.push_back(-1);
+                }
+                break;
+            case cv::RETR_CCOMP:
+                indices.push_back(i);
+                parents.push_back(depths_[i] % 2 == 1 ? tree_parent : -1);
+                break;
+            default:
+                throw std::runtime_error(std::format("Unsupported retrieval mode: {}\n", mode));
+            }
+        }
+        return makeView(std::move(indices), parents);
+    }
+
+    /// <summary>
+    /// Draws contours straight from the arena, i = -1 draws every contour of the view.
+    /// Negative thickness fills the contours like cv::drawContours with cv::FILLED, nested contours leave holes.
+    /// </summary>
+    void draw(cv::Mat& img, const ContourView& contours, int i, const cv::Scalar& color, int thickness = 1, int line_type = cv::LINE_8) const {
+        std::vector<const cv::Point*> pts;
+        std::vector<int> counts;
+        for (int k{ 0 }; k < static_cast<int>(contours.indices.size()); ++k) {
+            if (i >= 0 && k != i) {
+                continue;
+            }
+            auto contour{ getContour(contours.indices[k]) };
+            pts.push_back(contour.data());
+            counts.push_back(static_cast<int>(contour.size()));
+        }
+        if (pts.empty()) {
+            return;
+        }
+        // polylines asserts positive thickness
+        if (thickness < 0) {
+            cv::fillPoly(img, pts.data(), counts.data(), static_cast<int>(pts.size()), color, line_type);
+        }
+        else {
+            cv::polylines(img, pts.data(), counts.data(), static_cast<int>(pts.size()), true, color, thickness, line_type);
+        }
+    }
+
+private:
+    std::vector<cv::Point> points_;
+    std::vector<std::pair<std::size_t, std::size_t>> spans_;
+    std::vector<cv::Vec4i> hierarchy_;
+    std::vector<int> depths_;
+
+    std::vector<cv::Moments> moments_;
+    std::vector<double> areas_;
+    std::vector<double> perimeters_;
+
+    int depth(int i) {
+        if (depths_[i] < 0) {
+            const int parent{ hierarchy_[i][3] };
+            depths_[i] = parent < 0 ? 0 : depth(parent) + 1;
+        }
+        return depths_[i];
+    }
+
+    /// <summary>
+    /// Contour as cv::Mat header on the arena, no copy
+    /// </summary>
+    cv::Mat asMat(int i) const {
+        auto contour{ getContour(i) };
+        return cv::Mat(static_cast<int>(contour.size()), 1, CV_32SC2, const_cast<cv::Point*>(contour.data()));
+    }
+
+    void computeMeasures() {
+        moments_.resize(size());
+        areas_.resize(size());
+        perimeters_.resize(size());
+
+        std::vector<int> indices(size());
+        std::iota(indices.begin(), indices.end(), 0);
+        std::for_each(std::execution::par, indices.begin(), indices.end(), [this](int i) {
+            cv::Mat contour{ asMat(i) };
+            moments_[i] = cv::moments(contour);
+            areas_[i] = cv::contourArea(contour);
+            perimeters_[i] = cv::arcLength(contour, true);
+            });
+    }
+
+    /// <summary>
+    /// Builds hierarchy of a view, siblings keep the order of the tree
+    /// </summary>
+    static ContourView makeView(std::vector<int> indices, const std::vector<int>& parents) {
+        ContourView view;
+        view.hierarchy.assign(indices.size(), cv::Vec4i(-1, -1, -1, -1));
+
+        // Position of a contour in the view
+        int max_index{ indices.empty() ? 0 : *std::ranges::max_element(indices) };
+        std::vector<int> position(max_index + 1, -1);
+        for (int k{ 0 }; k < static_cast<int>(indices.size()); ++k) {
+            position[indices[k]] = k;
+        }
+
+        // Last child of every parent, the last slot is for top level contours
+        std::vector<int> last_child(indices.size() + 1, -1);
+        for (int k{ 0 }; k < static_cast<int>(indices.size()); ++k) {
+            const int parent{ parents[k] < 0 ? -1 : position[parents[k]] };
+            auto& hierarchy{ view.hierarchy[k] };
+            hierarchy[3] = parent;
+
+            int& last{ last_child[parent < 0 ? indices.size() : parent] };
+            if (last < 0) {
+                if (parent >= 0) {
+                    view.hierarchy[parent][2] = k;
+                }
+            }
+            else {
+                view.hierarchy[last][0] = k;
+                hierarchy[1] = last;
+            }
+            last = k;
+        }
+
+        view.indices = std::move(indices);
+        return view;
+    }
+};
@@ -6,6 +6,37 @@
 #include <ranges>
 #include <stdexcept>
 #include <vector>
+#include <print>
+#include "parallel_blob_detector.hpp"
+#include "../../common/timing.hpp"
+
+/// <summary>
+/// Runs cv::SimpleBlobDetector and ParallelBlobDetector with the same parameters, prints times and the largest
+/// difference between keypoints (both detectors return keypoints in the same order)
+/// </summary>
+void compare(const cv::Mat& img, const cv::SimpleBlobDetector::Params& params, const std::string& name) {
+    constexpr int repetitions{ 20 };
+    auto reference_detector{ cv::SimpleBlobDetector::create(params) };
+    ParallelBlobDetector detector{ params };
+
+    std::vector<cv::KeyPoint> reference, result;
+    double cv_ms{ measureMs([&] { reference_detector->detect(img, reference); }, repetitions) };
+    double parallel_ms{ measureMs([&] { detector.detect(img, result); }, repetitions) };
+
+    double max_shift{ 0 };
+    double max_size{ 0 };
+    if (reference.size() == result.size()) {
+        for (std::size_t i{ 0 }; i < result.size(); ++i) {
+            max_shift = std::max(max_shift, cv::norm(reference[i].pt - result[i].pt));
+            max_size = std::max(max_size, static_cast<double>(std::abs(reference[i].size - result[i].size)));
+        }
+    }
+    std::println("{}: SimpleBlobDetector {:.2f} ms ({} blobs), ParallelBlobDetector {:.2f} ms ({} blobs), speedup {:.2f}x",
+        name, cv_ms, reference.size(), parallel_ms, result.size(), cv_ms / parallel_ms);
+    if (reference.size() == result.size()) {
+        std::println("    largest difference: centre {:.4f} px, size {:.4f} px", max_shift, max_size);
+    }
+}
 
 int main() {
     // Path to an image 
@@ -29,10 +60,16 @@ int main() {
     // Convert that image into 3-channel image
     cv::cvtColor(blob, blob, cv::COLOR_GRAY2BGR);
 
-    // Set up detector with default parameters
-    cv::Ptr<cv::SimpleBlobDetector> detector{ cv::SimpleBlobDetector::create() };
+    // Set up detector with default parameters, the same as cv::SimpleBlobDetector::create()
     std::vector<cv::KeyPoint> keypoints;
-    detector->detect(img, keypoints);
+    try {
+        ParallelBlobDetector detector;
+        detector.detect(img, keypoints);
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
 
     // Generate random values in range 0-255
     std::random_device rd;
@@ -76,8 +113,14 @@ int main() {
     params.filterByInertia = true;
     params.minInertiaRatio = 0.01;
 
-    detector = cv::SimpleBlobDetector::create(params);
-    detector->detect(img, keypoints);
+    try {
+        ParallelBlobDetector detector{ params };
+        detector.detect(img, keypoints);
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
 
     // Clone the image
     auto blob_parametrized{ img.clone() };
@@ -99,6 +142,9 @@ int main() {
         cv::circle(blob_parametrized, center, radius, color, 2);
         });
 
+    compare(img, cv::SimpleBlobDetector::Params(), "default");
+    compare(img, params, "parametrized");
+
     cv::imshow("Original", img);
     cv::imshow("Blobs", blob);
     cv::imshow("Blobs Parametrized", blob_parametrized);
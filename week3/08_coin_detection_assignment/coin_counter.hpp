@@ -0,0 +1,226 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <stdexcept>
+#include <format>
+#include <vector>
+#include <array>
+#include <string>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <numbers>
+#include "../02_erosion_and_dilation/morphology_engine.hpp"
+#include "../05_connected_components_Analysis/component_analysis.hpp"
+
+/// <summary>
+/// Coin found by CoinCounter
+/// </summary>
+struct Coin {
+    ComponentStats stats;
+    double circularity;
+};
+
+/// <summary>
+/// Result of CoinCounter for a single image
+/// </summary>
+struct CoinCount {
+    std::vector<Coin> coins;
+    // Selected channel: 0 - blue, 1 - green, 2 - red, 3 - gray
+    int channel{ 0 };
+    double threshold{ 0 };
+    // True if coins are darker than the background
+    bool inverted{ false };
+    // Components rejected by area or circularity
+    int rejected{ 0 };
+};
+
+/// <summary>
+/// Automatic coin counting without any tuning:
+///     1. channel selection - histograms of B, G, R and gray, the channel whose Otsu split explains the largest part
+///        of its variance wins
+///     2. Otsu threshold computed from the same histogram, polarity chosen so the image border is background
+///     3. opening removes specks, closing fills reflections on coins (MorphologyEngine, elliptic kernel)
+///     4. connected components (ComponentAnalysis), cheap area filter on component statistics
+///     5. circularity 4 * pi * area / perimeter^2 of the outer contour, only for components which passed the area filter
+/// count() doesn't change the counter, so many images can be counted in parallel.
+/// </summary>
+class CoinCounter {
+public:
+    /// <param name="kernel_size">Size of the morphology kernel, 0 picks about 1% of the shorter image side</param>
+    /// <param name="min_area">Smallest coin as a fraction of the image area</param>
+    /// <param name="max_area">Largest coin as a fraction of the image area</param>
+    /// <param name="min_circularity">Smallest circularity of a coin, 1 is a perfect circle</param>
+    CoinCounter(int kernel_size = 0, double min_area = 0.001, double max_area = 0.25, double min_circularity = 0.7)
+        : kernel_size_(kernel_size), min_area_(min_area), max_area_(max_area), min_circularity_(min_circularity) {
+        if (kernel_size < 0 || min_area < 0 || max_area <= min_area) {
+            throw std::runtime_error(std::format("Wrong coin counter parameters: kernel {}, area [{}, {}]\n", kernel_size, min_area, max_area));
+        }
+    }
+
+    CoinCount count(const cv::Mat& img) const {
+        if (img.empty() || img.depth() != CV_8U || (img.channels() != 1 && img.channels() != 3)) {
+            throw std::runtime_error("Coin counter works only with 8-bit gray or BGR images!\n");
+        }
+
+        CoinCount result;
+        cv::Mat binary;
+        {
+            // 1. Channel with the best separation of two classes
+            std::vector<cv::Mat> channels;
+            if (img.channels() == 3) {
+                cv::split(img, channels);
+                channels.emplace_back();
+                cv::cvtColor(img, channels.back(), cv::COLOR_BGR2GRAY);
+            }
+            else {
+                channels.push_back(img);
+            }
+
+            std::vector<Otsu> splits(channels.size());
+            std::vector<int> indices(channels.size());
+            std::iota(indices.begin(), indices.end(), 0);
+            std::for_each(std::execution::par, indices.begin(), indices.end(), [&](int c) {
+                splits[c] = otsu(histogram(channels[c]));
+                });
+            auto best{ std::ranges::max_element(splits, {}, &Otsu::separability) - splits.begin() };
+            result.channel = img.channels() == 3 ? static_cast<int>(best) : 3;
+            result.threshold = splits[best].threshold;
+
+            // 2. Most of the border is background
+            const cv::Mat& channel{ channels[best] };
+            result.inverted = borderAbove(channel, splits[best].threshold) > 0.5;
+            cv::threshold(channel, binary, splits[best].threshold, 255, result.inverted ? cv::THRESH_BINARY_INV : cv::THRESH_BINARY);
+        }
+
+        // 3. Clean the mask
+        const int size{ kernel_size_ > 0 ? kernel_size_ : std::max(3, std::min(img.rows, img.cols) / 100 | 1) };
+        auto element{ cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(size, size)) };
+        cv::Mat cleaned;
+        morphology_.morphologyEx(binary, cleaned, cv::MORPH_OPEN, element);
+        morphology_.morphologyEx(cleaned, cleaned, cv::MORPH_CLOSE, element);
+
+        // 4. Components and area filter
+        ComponentAnalysis components;
+        components.process(cleaned);
+        const double image_area{ static_cast<double>(img.total()) };
+        std::vector<int> candidates;
+        for (const auto& stats : components.getStats()) {
+            const double area{ stats.area / image_area };
+            if (area >= min_area_ && area <= max_area_) {
+                candidates.push_back(stats.label);
+            }
+        }
+
+        // 5. Circularity of the remaining components
+        std::vector<double> circularities(candidates.size());
+        std::vector<int> positions(candidates.size());
+        std::iota(positions.begin(), positions.end(), 0);
+        std::for_each(std::execution::par, positions.begin(), positions.end(), [&](int i) {
+            circularities[i] = circularity(components.getMask(candidates[i]));
+            });
+
+        for (std::size_t i{ 0 }; i < candidates.size(); ++i) {
+            if (circularities[i] >= min_circularity_) {
+                result.coins.push_back({ components.getStats()[candidates[i] - 1], circularities[i] });
+            }
+        }
+        result.rejected = components.getComponentCount() - static_cast<int>(result.coins.size());
+        return result;
+    }
+
+private:
+    struct Otsu {
+        double threshold{ 0 };
+        // Between-class variance divided by total variance, from 0 (one class) to 1 (two flat classes)
+        double separability{ 0 };
+    };
+
+    int kernel_size_;
+    double min_area_;
+    double max_area_;
+    double min_circularity_;
+    MorphologyEngine morphology_;
+
+    static std::array<double, 256> histogram(const cv::Mat& channel) {
+        std::array<double, 256> hist{};
+        for (int y{ 0 }; y < channel.rows; ++y) {
+            const uchar* row{ channel.ptr<uchar>(y) };
+            for (int x{ 0 }; x < channel.cols; ++x) {
+                ++hist[row[x]];
+            }
+        }
+        return hist;
+    }
+
+    /// <summary>
+    /// The same threshold as THRESH_OTSU, maximum of between-class variance over all splits of the histogram
+    /// </summary>
+    static Otsu otsu(const std::array<double, 256>& hist) {
+        const double total{ std::accumulate(hist.begin(), hist.end(), 0.0) };
+        double sum{ 0 }, sum_squares{ 0 };
+        for (int i{ 0 }; i < 256; ++i) {
+            sum += i * hist[i];
+            sum_squares += static_cast<double>(i) * i * hist[i];
+        }
+        const double mean{ sum / total };
+        const double variance{ sum_squares / total - mean * mean };
+
+        Otsu best;
+        double best_between{ 0 };
+        double weight{ 0 }, partial{ 0 };
+        for (int i{ 0 }; i < 255; ++i) {
+            weight += hist[i] / total;
+            partial += i * hist[i] / total;
+            if (weight <= 0 || weight >= 1) {
+                continue;
+            }
+            const double diff{ mean * weight - partial };
+            const double between{ diff * diff / (weight * (1 - weight)) };
+            if (between > best_between) {
+                best_between = between;
+                best.threshold = i;
+            }
+        }
+        best.separability = variance > 0 ? best_between / variance : 0;
+        return best;
+    }
+
+    /// <summary>
+    /// Fraction of border pixels above the threshold
+    /// </summary>
+    static double borderAbove(const cv::Mat& channel, double threshold) {
+        int above{ 0 }, total{ 0 };
+        auto check = [&](int y, int x) {
+            above += channel.at<uchar>(y, x) > threshold;
+            ++total;
+            };
+        for (int x{ 0 }; x < channel.cols; ++x) {
+            check(0, x);
+            check(channel.rows - 1, x);
+        }
+        for (int y{ 1 }; y < channel.rows - 1; ++y) {
+            check(y, 0);
+            check(y, channel.cols - 1);
+        }
+        return static_cast<double>(above) / total;
+    }
+
+    /// <summary>
+    /// Circularity of the outer contour of a component mask, holes don't count
+    /// </summary>
+    static double circularity(const cv::Mat& mask) {
+        // One pixel of background around the mask, so contours never run along the image border
+        cv::Mat padded;
+        cv::copyMakeBorder(mask, padded, 1, 1, 1, 1, cv::BORDER_CONSTANT, cv::Scalar(0));
+        std::vector<std::vector<cv::Point>> contours;
+        cv::findContours(padded, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
+        if (contours.empty()) {
+            return 0;
+        }
+        const auto& contour{ *std::ranges::max_element(contours, {}, [](const auto& c) { return c.size(); }) };
+        const double perimeter{ cv::arcLength(contour, true) };
+        return perimeter > 0 ? 4 * std::numbers::pi * cv::contourArea(contour) / (perimeter * perimeter) : 0;
+    }
+};
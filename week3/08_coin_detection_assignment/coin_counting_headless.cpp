@@ -0,0 +1,96 @@
+#include <iostream>
+#include <opencv2/core.hpp>
+#include <opencv2/opencv.hpp>
+#include <stdexcept>
+#include <print>
+#include <vector>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <ranges>
+#include <array>
+#include <cctype>
+#include "coin_counter.hpp"
+
+struct ImageReport {
+    std::filesystem::path path;
+    CoinCount count;
+    double latency_ms{ 0 };
+    std::string error;
+};
+
+int main(int argc, char** argv) {
+    // Usage: coin_counting_headless [image directory] [kernel size, 0 - automatic] [min circularity]
+    std::filesystem::path directory{ argc > 1 ? argv[1] : "../data/images" };
+    int kernel_size{ argc > 2 ? std::stoi(argv[2]) : 0 };
+    double min_circularity{ argc > 3 ? std::stod(argv[3]) : 0.7 };
+
+    if (!std::filesystem::is_directory(directory)) {
+        std::cerr << std::format("{} is not a directory\n", directory.string());
+        return EXIT_FAILURE;
+    }
+
+    std::vector<ImageReport> reports;
+    const std::vector<std::string> extensions{ ".png", ".jpg", ".jpeg", ".bmp", ".tif", ".tiff" };
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        auto extension{ entry.path().extension().string() };
+        std::ranges::transform(extension, extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (entry.is_regular_file() && std::ranges::find(extensions, extension) != extensions.end()) {
+            reports.push_back({ entry.path() });
+        }
+    }
+    std::ranges::sort(reports, {}, &ImageReport::path);
+    if (reports.empty()) {
+        std::cerr << std::format("No images in {}\n", directory.string());
+        return EXIT_FAILURE;
+    }
+
+    try {
+        const CoinCounter counter{ kernel_size, 0.001, 0.25, min_circularity };
+        const std::array<std::string, 4> channel_names{ "blue", "green", "red", "gray" };
+
+        // Images are independent, latency covers decoding and counting of a single image
+        auto start{ std::chrono::steady_clock::now() };
+        std::for_each(std::execution::par, reports.begin(), reports.end(), [&counter](ImageReport& report) {
+            auto image_start{ std::chrono::steady_clock::now() };
+            try {
+                cv::Mat img{ cv::imread(report.path.string()) };
+                if (img.empty()) {
+                    throw std::runtime_error("can't load image");
+                }
+                report.count = counter.count(img);
+            }
+            catch (std::exception& e) {
+                report.error = e.what();
+            }
+            std::chrono::duration<double, std::milli> elapsed{ std::chrono::steady_clock::now() - image_start };
+            report.latency_ms = elapsed.count();
+            });
+        std::chrono::duration<double> total{ std::chrono::steady_clock::now() - start };
+
+        std::println("{:<30} {:>6} {:>8} {:>9} {:>8} {:>12}", "image", "coins", "rejected", "channel", "thresh", "latency [ms]");
+        for (const auto& report : reports) {
+            if (!report.error.empty()) {
+                std::println("{:<30} error: {}", report.path.filename().string(), report.error);
+                continue;
+            }
+            std::println("{:<30} {:>6} {:>8} {:>9} {:>8} {:>12.2f}",
+                report.path.filename().string(), report.count.coins.size(), report.count.rejected,
+                std::format("{}{}", channel_names.at(report.count.channel), report.count.inverted ? " inv" : ""),
+                report.count.threshold, report.latency_ms);
+        }
+
+        auto latencies{ reports | std::views::transform(&ImageReport::latency_ms) };
+        double mean_latency{ std::accumulate(latencies.begin(), latencies.end(), 0.0) / reports.size() };
+        std::println("{} images in {:.2f} s ({:.2f} images/s), mean latency {:.2f} ms",
+            reports.size(), total.count(), reports.size() / total.count(), mean_latency);
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return 0;
+}
@@ -7,12 +7,17 @@
 #include <print>
 #include <stdexcept>
 #include <vector>
+#include "../02_erosion_and_dilation/morphology_engine.hpp"
+#include "stage_cache.hpp"
 
 
 struct CoinDetection {
     cv::Mat src, gray;
     std::vector<cv::Mat> split;
 
+    // Input of the threshold stage: 0 - gray, 1 - blue, 2 - green, 3 - red
+    int channel{ 0 };
+
     // Window name
     const std::string image_window{ "Processed Image" };
     const std::string thresh_window{ "Threshold Controls" };
@@ -53,32 +58,51 @@ struct CoinDetection {
     std::string number_kernel_morph_types{ "Kernel Types" };
     std::string number_kernel_steps{ "Kernel Steps" };
     std::string numer_of_iterations{ "Number of iterations" };
+    MorphologyEngine morphology;
+
+    // Outputs of every stage keyed by its parameters and the version of its input
+    StageCache cache;
+    std::uint64_t thresholded_version{ 0 };
+
+    const cv::Mat& source() const {
+        return channel == 0 ? gray : split.at(channel - 1);
+    }
 };
 
 void thresholdImage(CoinDetection& cd) {
-    cv::threshold(cd.gray, cd.thresholded, cd.threshold_min_value, cd.threshold_max_value, cd.threshold_type);
-}
-
-void ProcessThreshold(int, void* data) {
-    auto* cd = static_cast<CoinDetection*>(data);
-    thresholdImage(*cd);
-    cv::imshow(cd->thresh_window, cd->thresholded);
+    const cv::Mat& source{ cd.source() };
+    auto result{ cd.cache.get("threshold", { cd.threshold_type, cd.threshold_min_value, cd.threshold_max_value },
+        StageCache::sourceVersion("channel", cd.channel), [&] {
+            cv::Mat thresholded;
+            cv::threshold(source, thresholded, cd.threshold_min_value, cd.threshold_max_value, cd.threshold_type);
+            return thresholded;
+        }) };
+    cd.thresholded = result.output;
+    cd.thresholded_version = result.version;
 }
 
 void morphImage(CoinDetection& cd) {
-    auto element{ cv::getStructuringElement(cd.kernel_morph_type, cv::Size(cd.kernel_size, cd.kernel_size)) };
-    if (cd.morph_type == 0) {
-        cv::erode(cd.thresholded, cd.morphed, element, cv::Point(-1, -1), cd.number_of_iterations);
-    }
-    else if (cd.morph_type == 1) {
-        cv::dilate(cd.thresholded, cd.morphed, element, cv::Point(-1, -1), cd.number_of_iterations);
-    }
-    else if (cd.morph_type == 2) {
-        cv::morphologyEx(cd.thresholded, cd.morphed, cv::MORPH_CLOSE, element, cv::Point(-1, -1), cd.number_of_iterations);
-    }
-    else if (cd.morph_type == 3) {
-        cv::morphologyEx(cd.thresholded, cd.morphed, cv::MORPH_OPEN, element, cv::Point(-1, -1), cd.number_of_iterations);
-    }
+    // Big kernels and many iterations cost the same as small ones
+    cd.kernel_size = 3 + cd.kernel_multiplier * 2;
+    auto result{ cd.cache.get("morphology", { cd.morph_type, cd.kernel_morph_type, cd.kernel_size, cd.number_of_iterations },
+        cd.thresholded_version, [&cd] {
+            auto element{ cv::getStructuringElement(cd.kernel_morph_type, cv::Size(cd.kernel_size, cd.kernel_size)) };
+            cv::Mat morphed;
+            if (cd.morph_type == 0) {
+                cd.morphology.erode(cd.thresholded, morphed, element, cv::Point(-1, -1), cd.number_of_iterations);
+            }
+            else if (cd.morph_type == 1) {
+                cd.morphology.dilate(cd.thresholded, morphed, element, cv::Point(-1, -1), cd.number_of_iterations);
+            }
+            else if (cd.morph_type == 2) {
+                cd.morphology.morphologyEx(cd.thresholded, morphed, cv::MORPH_CLOSE, element, cv::Point(-1, -1), cd.number_of_iterations);
+            }
+            else if (cd.morph_type == 3) {
+                cd.morphology.morphologyEx(cd.thresholded, morphed, cv::MORPH_OPEN, element, cv::Point(-1, -1), cd.number_of_iterations);
+            }
+            return morphed;
+        }) };
+    cd.morphed = result.output;
 }
 
 void ProcessMorph(int, void* data) {
@@ -87,6 +111,23 @@ void ProcessMorph(int, void* data) {
     cv::imshow(cd->morph_window, cd->morphed);
 }
 
+void ProcessThreshold(int, void* data) {
+    auto* cd = static_cast<CoinDetection*>(data);
+    thresholdImage(*cd);
+    cv::imshow(cd->thresh_window, cd->thresholded);
+    // Morphology is downstream of the threshold
+    ProcessMorph(0, data);
+}
+
+/// <summary>
+/// Switches input of the pipeline, stages already computed for that channel come from the cache
+/// </summary>
+void selectChannel(CoinDetection& cd, int channel) {
+    cd.channel = channel;
+    cv::imshow(cd.image_window, cd.source());
+    ProcessThreshold(0, &cd);
+}
+
 int main() {
     // Path to an image 
     std::string path{ "../data/images/CoinsA.png" };
@@ -109,7 +150,7 @@ int main() {
     cd.src = img.clone();
     cv::split(cd.src, cd.split);
     cv::cvtColor(cd.src, cd.gray, cv::COLOR_BGR2GRAY);
-    cd.thresholded = cd.gray.clone();
+    cd.thresholded = cd.gray;
 
     // Different windows
     cv::namedWindow(cd.image_window, cv::WINDOW_AUTOSIZE);
@@ -138,26 +179,25 @@ int main() {
             break;
         }
 
-        // Reset permanently image 
+        // Change input of the pipeline
         if (key == 'c') {
-            cd.thresholded = cd.gray.clone();
-            cv::imshow(cd.image_window, cd.gray);
+            selectChannel(cd, 0);
         }
         else if (key == 'b') {
-            cd.thresholded = cd.split.at(0).clone();
-            cv::imshow(cd.image_window, cd.split.at(0));
+            selectChannel(cd, 1);
         }
         else if (key == 'g') {
-            cd.thresholded = cd.split.at(1).clone();
-            cv::imshow(cd.image_window, cd.split.at(1));
+            selectChannel(cd, 2);
         }
         else if (key == 'r') {
-            cd.thresholded = cd.split.at(2).clone();
-            cv::imshow(cd.image_window, cd.split.at(2));
+            selectChannel(cd, 3);
         }
     }
 
     cv::destroyAllWindows();
 
+    std::println("Stage cache: {} hits, {} misses, {} entries, {:.1f} MB",
+        cd.cache.getHits(), cd.cache.getMisses(), cd.cache.getEntries(), cd.cache.getBytes() / (1024.0 * 1024.0));
+
     return 0;
 }
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <functional>
+#include <cstdint>
+
+/// <summary>
+/// Output of a pipeline stage. Version identifies the output by the stage, its parameters and the version of its input,
+/// so a recomputed output has the same version and stages downstream of it stay cached.
+/// </summary>
+struct StageOutput {
+    cv::Mat output;
+    std::uint64_t version{ 0 };
+};
+
+/// <summary>
+/// Memoization of pipeline stages keyed by (stage, parameters, input version) with a memory budget.
+/// The least recently used outputs are dropped when the budget is exceeded, the newest output is always kept.
+/// Outputs are shared cv::Mat headers, callers must not write into them.
+/// </summary>
+class StageCache {
+public:
+    StageCache(std::size_t budget_bytes = 256 * 1024 * 1024) : budget_(budget_bytes) {}
+
+    /// <summary>
+    /// Version of an input which isn't produced by any stage, e.g. a channel of the source image
+    /// </summary>
+    static std::uint64_t sourceVersion(const std::string& name, int index) {
+        return combine(std::hash<std::string>{}(name), static_cast<std::uint64_t>(index));
+    }
+
+    /// <summary>
+    /// Returns cached output of a stage or computes and stores it
+    /// </summary>
+    StageOutput get(const std::string& stage, const std::vector<int>& params, std::uint64_t input_version, const std::function<cv::Mat()>& compute) {
+        Key key{ stage, params, input_version };
+        if (auto it{ entries_.find(key) }; it != entries_.end()) {
+            ++hits_;
+            // Move to the front of the LRU list
+            order_.splice(order_.begin(), order_, it->second);
+            return it->second->output;
+        }
+
+        ++misses_;
+        StageOutput output{ compute(), KeyHash{}(key) };
+        bytes_ += size(output.output);
+        order_.push_front({ key, output });
+        entries_.emplace(std::move(key), order_.begin());
+        evict();
+        return output;
+    }
+
+    void clear() {
+        order_.clear();
+        entries_.clear();
+        bytes_ = 0;
+    }
+
+    std::size_t getHits() const {
+        return hits_;
+    }
+
+    std::size_t getMisses() const {
+        return misses_;
+    }
+
+    std::size_t getBytes() const {
+        return bytes_;
+    }
+
+    std::size_t getEntries() const {
+        return entries_.size();
+    }
+
+private:
+    struct Key {
+        std::string stage;
+        std::vector<int> params;
+        std::uint64_t input_version;
+
+        bool operator==(const Key&) const = default;
+    };
+
+    struct KeyHash {
+        std::size_t operator()(const Key& key) const {
+            std::uint64_t hash{ combine(std::hash<std::string>{}(key.stage), key.input_version) };
+            for (int param : key.params) {
+                hash = combine(hash, static_cast<std::uint64_t>(static_cast<std::uint32_t>(param)));
+            }
+            return hash;
+        }
+    };
+
+    struct Entry {
+        Key key;
+        StageOutput output;
+    };
+
+    std::size_t budget_;
+    std::size_t bytes_{ 0 };
+    std::size_t hits_{ 0 };
+    std::size_t misses_{ 0 };
+    // Most recently used first
+    std::list<Entry> order_;
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> entries_;
+
+    static std::uint64_t combine(std::uint64_t seed, std::uint64_t value) {
+        return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+    }
+
+    static std::size_t size(const cv::Mat& mat) {
+        return mat.total() * mat.elemSize();
+    }
+
+    void evict() {
+        while (bytes_ > budget_ && order_.size() > 1) {
+            const auto& last{ order_.back() };
+            bytes_ -= size(last.output.output);
+            entries_.erase(last.key);
+            order_.pop_back();
+        }
+    }
+};
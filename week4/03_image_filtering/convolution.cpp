@@ -4,8 +4,76 @@
 #include <opencv2/highgui.hpp>
 #include <stdexcept>
 #include <vector>
+#include <print>
+#include <optional>
+#include <string>
+#include "convolution_engine.hpp"
+#include "../../common/timing.hpp"
 
+/// <summary>
+/// Times cv::filter2D and every strategy which fits a kernel, each with its largest difference from cv::filter2D,
+/// then prints the size where FFT starts to beat the direct convolution of non-separable kernels
+/// </summary>
+void benchmark(const cv::Mat& img, const ConvolutionEngine& engine) {
+    constexpr int repetitions{ 5 };
+    const std::vector<int> sizes{ 3, 5, 7, 9, 11, 15, 21, 31 };
+    const std::vector<ConvolutionStrategy> strategies{ ConvolutionStrategy::Box, ConvolutionStrategy::Separable, ConvolutionStrategy::Direct, ConvolutionStrategy::Fft };
 
+    auto makeKernel = [](const std::string& kind, int size) {
+        if (kind == "box") {
+            return cv::Mat(cv::Mat::ones(size, size, CV_32F) / static_cast<float>(size * size));
+        }
+        if (kind == "gaussian") {
+            cv::Mat gaussian{ cv::getGaussianKernel(size, -1, CV_32F) };
+            return cv::Mat(gaussian * gaussian.t());
+        }
+        cv::Mat random(size, size, CV_32F);
+        cv::randu(random, -1, 1);
+        return cv::Mat(random / static_cast<float>(size * size));
+    };
+
+    std::println("{}x{} image, {} channels", img.cols, img.rows, img.channels());
+    std::println("Strategy cells: ms (max difference from filter2D)");
+    std::println("{:>9} {:>5} {:>10} {:>12} {:>12} {:>12} {:>12} {:>12}", "kernel", "size", "filter2D", "box", "separable", "direct", "fft", "auto");
+    std::optional<int> crossover;
+    for (const std::string kind : { "box", "gaussian", "random" }) {
+        for (int size : sizes) {
+            cv::Mat kernel{ makeKernel(kind, size) };
+            cv::Mat reference, result;
+            double cv_ms{ measureMs([&] { cv::filter2D(img, reference, -1, kernel); }, repetitions) };
+
+            std::vector<std::string> cells;
+            std::vector<double> times(strategies.size(), -1);
+            for (std::size_t s{ 0 }; s < strategies.size(); ++s) {
+                try {
+                    times[s] = measureMs([&] { engine.filter(img, result, kernel, strategies[s]); }, repetitions);
+                    cells.push_back(std::format("{:.2f} ({:.0f})", times[s], cv::norm(reference, result, cv::NORM_INF)));
+                }
+                catch (std::exception&) {
+                    // Box and Separable don't fit every kernel
+                    cells.push_back("-");
+                }
+            }
+            double auto_ms{ measureMs([&] { engine.filter(img, result, kernel); }, repetitions) };
+            cells.push_back(std::format("{:.2f} ({:.0f})", auto_ms, cv::norm(reference, result, cv::NORM_INF)));
+
+            std::println("{:>9} {:>5} {:>10.2f} {:>12} {:>12} {:>12} {:>12} {:>12}   -> {}",
+                kind, size, cv_ms, cells[0], cells[1], cells[2], cells[3], cells[4],
+                convolutionStrategyName(engine.choose(kernel)));
+
+            if (kind == "random" && !crossover && times[3] < times[2]) {
+                crossover = size;
+            }
+        }
+    }
+
+    if (crossover) {
+        std::println("FFT beats direct convolution from {0}x{0} kernels, fft_min_area = {1}", *crossover, *crossover * *crossover);
+    }
+    else {
+        std::println("Direct convolution was faster than FFT for every size");
+    }
+}
 
 int main() {
     // Path to an image 
@@ -40,8 +108,12 @@ int main() {
 
     cv::Mat output;
 
-    // Apply filter
-    cv::filter2D(img, output, -1, kernel);
+    // Apply filter, a box kernel is filtered with running sums instead of 25 multiplications per pixel
+    ConvolutionEngine engine;
+    std::println("Strategy: {}", convolutionStrategyName(engine.choose(kernel)));
+    engine.filter(img, output, kernel);
+
+    benchmark(img, engine);
 
     cv::imshow("Original", img);
     cv::imshow("After filtration", output);
@@ -0,0 +1,332 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <stdexcept>
+#include <format>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <cmath>
+
+enum class ConvolutionStrategy {
+    Box,
+    Separable,
+    Fft,
+    Direct
+};
+
+inline std::string_view convolutionStrategyName(ConvolutionStrategy strategy) {
+    switch (strategy) {
+    case ConvolutionStrategy::Box:
+        return "Box";
+    case ConvolutionStrategy::Separable:
+        return "Separable";
+    case ConvolutionStrategy::Fft:
+        return "FFT";
+    case ConvolutionStrategy::Direct:
+        return "Direct";
+    }
+    return "Unknown";
+}
+
+/// <summary>
+/// Same filtering as cv::filter2D with ddepth = -1 (correlation with the kernel, anchor, delta and border),
+/// with the algorithm chosen from the kernel:
+///     - Box - all elements equal, running sums, cost independent of the kernel size
+///     - Separable - rank 1 kernel found with SVD, a horizontal and a vertical 1D pass
+///     - FFT - large kernels which aren't separable, product of spectra of every channel
+///     - Direct - small kernels which aren't separable, row bands of the output accumulated one kernel element at
+///       a time over contiguous rows, so the inner loop is vectorized by the compiler
+/// The image is padded once with the requested border, every strategy works on 32-bit floats of the padded image,
+/// channels stay interleaved. Results differ from cv::filter2D only by rounding.
+/// </summary>
+class ConvolutionEngine {
+public:
+    /// <param name="fft_min_area">Smallest kernel area (rows * cols) filtered with FFT when it isn't separable</param>
+    /// <param name="tolerance">Relative tolerance of the box and rank 1 tests</param>
+    ConvolutionEngine(int fft_min_area = 121, double tolerance = 1e-6, int band_rows = 32, int tile_floats = 2048)
+        : fft_min_area_(fft_min_area), tolerance_(tolerance), band_rows_(std::max(band_rows, 1)), tile_floats_(std::max(tile_floats, 16)) {}
+
+    /// <summary>
+    /// Strategy used by filter for a kernel
+    /// </summary>
+    ConvolutionStrategy choose(const cv::Mat& kernel) const {
+        if (isBox(kernel)) {
+            return ConvolutionStrategy::Box;
+        }
+        cv::Mat column, row;
+        if (separate(kernel, column, row)) {
+            return ConvolutionStrategy::Separable;
+        }
+        return kernel.rows * kernel.cols >= fft_min_area_ ? ConvolutionStrategy::Fft : ConvolutionStrategy::Direct;
+    }
+
+    void filter(const cv::Mat& src, cv::Mat& dst, const cv::Mat& kernel, cv::Point anchor = { -1, -1 }, double delta = 0, int border = cv::BORDER_DEFAULT) const {
+        filter(src, dst, kernel, choose(kernel), anchor, delta, border);
+    }
+
+    /// <summary>
+    /// Filtering with a given strategy, Box and Separable throw if the kernel doesn't allow them
+    /// </summary>
+    void filter(const cv::Mat& src, cv::Mat& dst, const cv::Mat& kernel, ConvolutionStrategy strategy, cv::Point anchor = { -1, -1 }, double delta = 0, int border = cv::BORDER_DEFAULT) const {
+        if (src.empty() || kernel.empty() || kernel.channels() != 1) {
+            throw std::runtime_error("Convolution needs an image and a single channel kernel!\n");
+        }
+        if (anchor.x < 0) {
+            anchor.x = kernel.cols / 2;
+        }
+        if (anchor.y < 0) {
+            anchor.y = kernel.rows / 2;
+        }
+        if (anchor.x >= kernel.cols || anchor.y >= kernel.rows) {
+            throw std::runtime_error(std::format("Anchor ({}, {}) outside of {}x{} kernel\n", anchor.x, anchor.y, kernel.cols, kernel.rows));
+        }
+
+        cv::Mat kernel64;
+        kernel.convertTo(kernel64, CV_64F);
+
+        // One padding for every strategy, output pixel (x, y) is the correlation of padded(y..y+kh, x..x+kw) with the kernel.
+        // Padding is taken from src itself, so without BORDER_ISOLATED an ROI uses pixels of its parent like filter2D
+        cv::Mat padded;
+        cv::copyMakeBorder(src, padded, anchor.y, kernel.rows - 1 - anchor.y, anchor.x, kernel.cols - 1 - anchor.x, border);
+        padded.convertTo(padded, CV_MAKETYPE(CV_32F, src.channels()));
+
+        cv::Mat result(src.size(), CV_MAKETYPE(CV_32F, src.channels()));
+        switch (strategy) {
+        case ConvolutionStrategy::Box:
+            if (!isBox(kernel64)) {
+                throw std::runtime_error("Box strategy needs a kernel with equal elements!\n");
+            }
+            box(padded, result, kernel.size(), kernel64.at<double>(0, 0));
+            break;
+        case ConvolutionStrategy::Separable: {
+            cv::Mat column, row;
+            if (!separate(kernel64, column, row)) {
+                throw std::runtime_error("Separable strategy needs a rank 1 kernel!\n");
+            }
+            separable(padded, result, column, row);
+            break;
+        }
+        case ConvolutionStrategy::Fft:
+            fft(padded, result, kernel64);
+            break;
+        case ConvolutionStrategy::Direct:
+            direct(padded, result, kernel64);
+            break;
+        }
+
+        result.convertTo(dst, src.type(), 1, delta);
+    }
+
+    /// <summary>
+    /// Splits a rank 1 kernel into a column and a row, kernel = column * row
+    /// </summary>
+    bool separate(const cv::Mat& kernel, cv::Mat& column, cv::Mat& row) const {
+        cv::Mat kernel64;
+        kernel.convertTo(kernel64, CV_64F);
+        if (kernel64.rows == 1 || kernel64.cols == 1) {
+            column = kernel64.cols == 1 ? kernel64.clone() : cv::Mat::ones(1, 1, CV_64F);
+            row = kernel64.rows == 1 ? kernel64.clone() : cv::Mat::ones(1, 1, CV_64F);
+            return true;
+        }
+
+        cv::Mat w, u, vt;
+        cv::SVD::compute(kernel64, w, u, vt);
+        const double largest{ w.at<double>(0) };
+        if (largest <= 0 || w.at<double>(1) > tolerance_ * largest) {
+            return false;
+        }
+        const double scale{ std::sqrt(largest) };
+        column = u.col(0) * scale;
+        row = vt.row(0) * scale;
+        return true;
+    }
+
+private:
+    int fft_min_area_;
+    double tolerance_;
+    int band_rows_;
+    int tile_floats_;
+
+    bool isBox(const cv::Mat& kernel) const {
+        cv::Mat kernel64;
+        kernel.convertTo(kernel64, CV_64F);
+        double low, high;
+        cv::minMaxLoc(kernel64, &low, &high);
+        return high - low <= tolerance_ * std::max(std::abs(high), std::abs(low));
+    }
+
+    /// <summary>
+    /// Runs a function on bands of output rows in parallel
+    /// </summary>
+    template<typename Function>
+    void forBands(int rows, Function&& function) const {
+        std::vector<int> bands((rows + band_rows_ - 1) / band_rows_);
+        std::iota(bands.begin(), bands.end(), 0);
+        std::for_each(std::execution::par, bands.begin(), bands.end(), [&](int band) {
+            function(band * band_rows_, std::min((band + 1) * band_rows_, rows));
+            });
+    }
+
+    /// <summary>
+    /// Sum over the window with running sums in double precision, horizontal sums slide along every row
+    /// and vertical sums slide down the band, then the sum is multiplied by the kernel value
+    /// </summary>
+    void box(const cv::Mat& padded, cv::Mat& result, cv::Size ksize, double value) const {
+        const int cn{ result.channels() };
+        const int width{ result.cols * cn };
+        forBands(result.rows, [&](int begin, int end) {
+            // Horizontal sums of padded rows [begin, end + kh - 1)
+            std::vector<double> horizontal(static_cast<std::size_t>(end - begin + ksize.height - 1) * width);
+            for (int r{ 0 }; r < end - begin + ksize.height - 1; ++r) {
+                const float* src{ padded.ptr<float>(begin + r) };
+                double* h{ horizontal.data() + static_cast<std::size_t>(r) * width };
+                for (int c{ 0 }; c < cn; ++c) {
+                    double sum{ 0 };
+                    for (int j{ 0 }; j < ksize.width; ++j) {
+                        sum += src[j * cn + c];
+                    }
+                    h[c] = sum;
+                }
+                for (int t{ cn }; t < width; ++t) {
+                    h[t] = h[t - cn] + src[t - cn + ksize.width * cn] - src[t - cn];
+                }
+            }
+
+            std::vector<double> vertical(width, 0.0);
+            for (int i{ 0 }; i < ksize.height; ++i) {
+                const double* h{ horizontal.data() + static_cast<std::size_t>(i) * width };
+                for (int t{ 0 }; t < width; ++t) {
+                    vertical[t] += h[t];
+                }
+            }
+            for (int y{ begin }; y < end; ++y) {
+                float* dst{ result.ptr<float>(y) };
+                for (int t{ 0 }; t < width; ++t) {
+                    dst[t] = static_cast<float>(vertical[t] * value);
+                }
+                if (y + 1 < end) {
+                    const double* leaving{ horizontal.data() + static_cast<std::size_t>(y - begin) * width };
+                    const double* entering{ horizontal.data() + static_cast<std::size_t>(y - begin + ksize.height) * width };
+                    for (int t{ 0 }; t < width; ++t) {
+                        vertical[t] += entering[t] - leaving[t];
+                    }
+                }
+            }
+            });
+    }
+
+    /// <summary>
+    /// Horizontal pass over the padded rows a band needs, then vertical pass into the band
+    /// </summary>
+    void separable(const cv::Mat& padded, cv::Mat& result, const cv::Mat& column, const cv::Mat& row) const {
+        const int cn{ result.channels() };
+        const int width{ result.cols * cn };
+        std::vector<float> kx(row.total()), ky(column.total());
+        for (int j{ 0 }; j < static_cast<int>(kx.size()); ++j) {
+            kx[j] = static_cast<float>(row.at<double>(j));
+        }
+        for (int i{ 0 }; i < static_cast<int>(ky.size()); ++i) {
+            ky[i] = static_cast<float>(column.at<double>(i));
+        }
+        const int kh{ static_cast<int>(ky.size()) };
+
+        forBands(result.rows, [&](int begin, int end) {
+            std::vector<float> horizontal(static_cast<std::size_t>(end - begin + kh - 1) * width, 0.0f);
+            for (int r{ 0 }; r < end - begin + kh - 1; ++r) {
+                const float* src{ padded.ptr<float>(begin + r) };
+                float* h{ horizontal.data() + static_cast<std::size_t>(r) * width };
+                for (int j{ 0 }; j < static_cast<int>(kx.size()); ++j) {
+                    const float k{ kx[j] };
+                    const float* s{ src + j * cn };
+                    for (int t{ 0 }; t < width; ++t) {
+                        h[t] += k * s[t];
+                    }
+                }
+            }
+            for (int y{ begin }; y < end; ++y) {
+                float* dst{ result.ptr<float>(y) };
+                std::fill(dst, dst + width, 0.0f);
+                for (int i{ 0 }; i < kh; ++i) {
+                    const float k{ ky[i] };
+                    const float* h{ horizontal.data() + static_cast<std::size_t>(y - begin + i) * width };
+                    for (int t{ 0 }; t < width; ++t) {
+                        dst[t] += k * h[t];
+                    }
+                }
+            }
+            });
+    }
+
+    /// <summary>
+    /// Every output row is split into tiles small enough to stay in L1 cache while all kernel elements are added
+    /// </summary>
+    void direct(const cv::Mat& padded, cv::Mat& result, const cv::Mat& kernel) const {
+        const int cn{ result.channels() };
+        const int width{ result.cols * cn };
+
+        // Zero elements don't contribute
+        struct Tap {
+            int row;
+            int offset;
+            float value;
+        };
+        std::vector<Tap> taps;
+        for (int i{ 0 }; i < kernel.rows; ++i) {
+            for (int j{ 0 }; j < kernel.cols; ++j) {
+                if (double value{ kernel.at<double>(i, j) }; value != 0) {
+                    taps.push_back({ i, j * cn, static_cast<float>(value) });
+                }
+            }
+        }
+
+        forBands(result.rows, [&](int begin, int end) {
+            for (int y{ begin }; y < end; ++y) {
+                float* dst{ result.ptr<float>(y) };
+                for (int tile{ 0 }; tile < width; tile += tile_floats_) {
+                    const int tile_end{ std::min(tile + tile_floats_, width) };
+                    std::fill(dst + tile, dst + tile_end, 0.0f);
+                    for (const auto& tap : taps) {
+                        const float* src{ padded.ptr<float>(y + tap.row) + tap.offset };
+                        const float k{ tap.value };
+                        for (int t{ tile }; t < tile_end; ++t) {
+                            dst[t] += k * src[t];
+                        }
+                    }
+                }
+            }
+            });
+    }
+
+    /// <summary>
+    /// Correlation as a product of the image spectrum and the conjugated kernel spectrum, channels in parallel.
+    /// The transform covers the whole padded image, so circular wrap never reaches valid output pixels.
+    /// </summary>
+    void fft(const cv::Mat& padded, cv::Mat& result, const cv::Mat& kernel) const {
+        const cv::Size size(cv::getOptimalDFTSize(padded.cols), cv::getOptimalDFTSize(padded.rows));
+
+        cv::Mat kernel_spectrum{ cv::Mat::zeros(size, CV_32F) };
+        cv::Mat kernel_roi{ kernel_spectrum(cv::Rect(0, 0, kernel.cols, kernel.rows)) };
+        kernel.convertTo(kernel_roi, CV_32F);
+        cv::dft(kernel_spectrum, kernel_spectrum, 0, kernel.rows);
+
+        std::vector<cv::Mat> planes;
+        cv::split(padded, planes);
+        std::vector<cv::Mat> filtered(planes.size());
+        std::vector<int> channels(planes.size());
+        std::iota(channels.begin(), channels.end(), 0);
+        std::for_each(std::execution::par, channels.begin(), channels.end(), [&](int c) {
+            cv::Mat spectrum{ cv::Mat::zeros(size, CV_32F) };
+            cv::Mat image_roi{ spectrum(cv::Rect(0, 0, padded.cols, padded.rows)) };
+            planes[c].copyTo(image_roi);
+            cv::dft(spectrum, spectrum, 0, padded.rows);
+            cv::mulSpectrums(spectrum, kernel_spectrum, spectrum, 0, true);
+            cv::dft(spectrum, spectrum, cv::DFT_INVERSE | cv::DFT_SCALE | cv::DFT_REAL_OUTPUT, result.rows);
+            filtered[c] = spectrum(cv::Rect(0, 0, result.cols, result.rows)).clone();
+            });
+        cv::merge(filtered, result);
+    }
+};
@@ -4,23 +4,15 @@
 #include <opencv2/highgui.hpp>
 #include <stdexcept>
 #include <print>
+#include "focus_scoring.hpp"
 
 auto calculateTenengradFocus(const cv::Mat& img) {
     if (img.channels() > 1) {
         throw std::runtime_error("This function requires grayscale image!\n");
     }
 
-    cv::Mat gradient_x, gradient_y;
-
-    // Calculate gradients in x and y directions
-    cv::Sobel(img, gradient_x, CV_64F, 1, 0);
-    cv::Sobel(img, gradient_y, CV_64F, 0, 1);
-
-    // Square both gradients and sum them up
-    cv::Mat gradient_magnitude = gradient_x.mul(gradient_x) + gradient_y.mul(gradient_y);
-
-    // Return sum of all pixels
-    return cv::sum(gradient_magnitude)[0];
+    // Sobel gradients, their squares and the sum are calculated in a single integer pass
+    return tenengradFocus(img);
 }
 
 int main() {
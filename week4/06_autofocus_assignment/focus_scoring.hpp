@@ -0,0 +1,531 @@
+#pragma once
+
+#include <iostream>
+#include <opencv2/core.hpp>
+#include <opencv2/opencv.hpp>
+#include <stdexcept>
+#include <format>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <thread>
+#include <exception>
+#include <cstdint>
+#include <limits>
+#include <chrono>
+#include <map>
+#include <algorithm>
+#include "../../week2/01_video_io/frame_source.hpp"
+
+enum class FocusMetric {
+    Tenengrad,
+    VarianceOfLaplacian,
+    Brenner
+};
+
+inline std::string_view focusMetricName(FocusMetric metric) {
+    switch (metric) {
+    case FocusMetric::Tenengrad:
+        return "Tenengrad";
+    case FocusMetric::VarianceOfLaplacian:
+        return "Variance of Laplacian";
+    case FocusMetric::Brenner:
+        return "Brenner";
+    }
+    return "Unknown";
+}
+
+/// <summary>
+/// Tenengrad focus measure - sum of squared 3x3 Sobel gradients over all pixels, the same value as cv::Sobel
+/// with the default BORDER_REFLECT_101.
+/// Sobel and sum of squares are fused into a single integer pass over the image, there are no float intermediates.
+/// Inner loop uses only 32-bit integer arithmetic on contiguous rows, so the compiler vectorizes it.
+/// </summary>
+inline double tenengradFocus(const cv::Mat& gray) {
+    if (gray.type() != CV_8UC1) {
+        throw std::runtime_error("This function requires 8-bit grayscale image!\n");
+    }
+
+    // |gx|, |gy| <= 1020, so a block of 256 pixels sums to less than 2^31
+    constexpr int block{ 256 };
+    std::int64_t sum{ 0 };
+
+    // One pixel wide frame with reflected neighbours, too small to be worth vectorizing
+    auto reflect = [](int i, int n) {
+        return n == 1 ? 0 : i < 0 ? -i : i >= n ? 2 * n - 2 - i : i;
+    };
+    auto border = [&](int y, int x) {
+        auto at = [&](int dy, int dx) {
+            return static_cast<std::int64_t>(gray.at<uchar>(reflect(y + dy, gray.rows), reflect(x + dx, gray.cols)));
+        };
+        const std::int64_t gx{ (at(-1, 1) + 2 * at(0, 1) + at(1, 1)) - (at(-1, -1) + 2 * at(0, -1) + at(1, -1)) };
+        const std::int64_t gy{ (at(1, -1) + 2 * at(1, 0) + at(1, 1)) - (at(-1, -1) + 2 * at(-1, 0) + at(-1, 1)) };
+        return gx * gx + gy * gy;
+    };
+    for (int x{ 0 }; x < gray.cols; ++x) {
+        sum += border(0, x);
+        if (gray.rows > 1) {
+            sum += border(gray.rows - 1, x);
+        }
+    }
+    for (int y{ 1 }; y < gray.rows - 1; ++y) {
+        sum += border(y, 0);
+        if (gray.cols > 1) {
+            sum += border(y, gray.cols - 1);
+        }
+    }
+
+    for (int y{ 1 }; y < gray.rows - 1; ++y) {
+        const uchar* r0{ gray.ptr<uchar>(y - 1) };
+        const uchar* r1{ gray.ptr<uchar>(y) };
+        const uchar* r2{ gray.ptr<uchar>(y + 1) };
+
+        for (int start{ 1 }; start < gray.cols - 1; start += block) {
+            const int end{ std::min(start + block, gray.cols - 1) };
+            std::int32_t block_sum{ 0 };
+            for (int x{ start }; x < end; ++x) {
+                std::int32_t gx{ (r0[x + 1] + 2 * r1[x + 1] + r2[x + 1]) - (r0[x - 1] + 2 * r1[x - 1] + r2[x - 1]) };
+                std::int32_t gy{ (r2[x - 1] + 2 * r2[x] + r2[x + 1]) - (r0[x - 1] + 2 * r0[x] + r0[x + 1]) };
+                block_sum += gx * gx + gy * gy;
+            }
+            sum += block_sum;
+        }
+    }
+    return static_cast<double>(sum);
+}
+
+/// <summary>
+/// Variance of 3x3 Laplacian over interior pixels, computed in a single integer pass
+/// </summary>
+inline double varianceOfLaplacianFocus(const cv::Mat& gray) {
+    if (gray.type() != CV_8UC1) {
+        throw std::runtime_error("This function requires 8-bit grayscale image!\n");
+    }
+    if (gray.rows < 3 || gray.cols < 3) {
+        return 0.0;
+    }
+
+    std::int64_t sum{ 0 };
+    std::int64_t sum_sq{ 0 };
+    for (int y{ 1 }; y < gray.rows - 1; ++y) {
+        const uchar* r0{ gray.ptr<uchar>(y - 1) };
+        const uchar* r1{ gray.ptr<uchar>(y) };
+        const uchar* r2{ gray.ptr<uchar>(y + 1) };
+
+        std::int32_t row_sum{ 0 };
+        std::int64_t row_sum_sq{ 0 };
+        for (int x{ 1 }; x < gray.cols - 1; ++x) {
+            std::int32_t laplacian{ r0[x] + r2[x] + r1[x - 1] + r1[x + 1] - 4 * r1[x] };
+            row_sum += laplacian;
+            row_sum_sq += laplacian * laplacian;
+        }
+        sum += row_sum;
+        sum_sq += row_sum_sq;
+    }
+
+    const double n{ static_cast<double>(gray.rows - 2) * (gray.cols - 2) };
+    const double mean{ sum / n };
+    return sum_sq / n - mean * mean;
+}
+
+/// <summary>
+/// Brenner focus measure - sum of squared differences between pixels two columns apart
+/// </summary>
+inline double brennerFocus(const cv::Mat& gray) {
+    if (gray.type() != CV_8UC1) {
+        throw std::runtime_error("This function requires 8-bit grayscale image!\n");
+    }
+
+    std::int64_t sum{ 0 };
+    for (int y{ 0 }; y < gray.rows; ++y) {
+        const uchar* row{ gray.ptr<uchar>(y) };
+
+        // Difference <= 255, so a row of up to 33000 pixels fits in 32 bits
+        std::int32_t row_sum{ 0 };
+        for (int x{ 0 }; x < gray.cols - 2; ++x) {
+            std::int32_t diff{ row[x + 2] - row[x] };
+            row_sum += diff * diff;
+        }
+        sum += row_sum;
+    }
+    return static_cast<double>(sum);
+}
+
+inline double focusScore(const cv::Mat& gray, FocusMetric metric) {
+    switch (metric) {
+    case FocusMetric::Tenengrad:
+        return tenengradFocus(gray);
+    case FocusMetric::VarianceOfLaplacian:
+        return varianceOfLaplacianFocus(gray);
+    case FocusMetric::Brenner:
+        return brennerFocus(gray);
+    }
+    throw std::runtime_error("Unknown focus metric!\n");
+}
+
+/// <summary>
+/// Best frame found for a single ROI and metric
+/// </summary>
+struct FocusResult {
+    std::size_t roi{};
+    FocusMetric metric{};
+    std::size_t best_frame{};
+    double best_score{ -std::numeric_limits<double>::infinity() };
+};
+
+/// <summary>
+/// Headless focus scoring of a video. Frames are decoded on one thread (FrameSource) and scored by a fixed set of
+/// workers which take frames straight from the bounded queue of the source. Every worker keeps its own best frame
+/// for every ROI and metric, they are merged when the video ends.
+/// </summary>
+class FocusScoringEngine {
+public:
+    FocusScoringEngine(std::vector<cv::Rect> rois, std::vector<FocusMetric> metrics, unsigned int threads = 0)
+        : rois_(std::move(rois)), metrics_(std::move(metrics)),
+        threads_(threads > 0 ? threads : std::max(std::thread::hardware_concurrency(), 1u)) {
+        if (rois_.empty() || metrics_.empty()) {
+            throw std::runtime_error("At least one ROI and one metric are needed!\n");
+        }
+    }
+
+    /// <summary>
+    /// Scores every frame of the video
+    /// </summary>
+    /// <param name="path">Path to the video</param>
+    /// <returns>Best frame for every ROI and metric</returns>
+    std::vector<FocusResult> process(const std::string& path) {
+        // Pool of the source must be larger than number of frames scored at the same time
+        FrameSource source{ path, threads_ + 2 };
+        const cv::Rect frame_rect{ cv::Point(0, 0), source.getSize() };
+
+        std::vector<FocusResult> results;
+        for (std::size_t r{ 0 }; r < rois_.size(); ++r) {
+            if ((rois_[r] & frame_rect) != rois_[r]) {
+                throw std::runtime_error(std::format("ROI #{} is outside of the frame!\n", r));
+            }
+            for (auto metric : metrics_) {
+                results.push_back({ r, metric });
+            }
+        }
+
+        std::vector<std::vector<FocusResult>> worker_results(threads_, results);
+        std::vector<std::size_t> worker_frames(threads_, 0);
+        std::vector<std::exception_ptr> errors(threads_);
+
+        auto start{ std::chrono::steady_clock::now() };
+        {
+            std::vector<std::jthread> workers;
+            workers.reserve(threads_);
+            for (unsigned int w{ 0 }; w < threads_; ++w) {
+                workers.emplace_back([&, w] {
+                    try {
+                        while (auto frame = source.next()) {
+                            update(worker_results[w], scoreFrame(frame->image()), frame->index());
+                            ++worker_frames[w];
+                        }
+                    }
+                    catch (...) {
+                        errors[w] = std::current_exception();
+                    }
+                    });
+            }
+        }
+        elapsed_ = std::chrono::steady_clock::now() - start;
+        decode_fps_ = source.getDecodeFps();
+
+        for (const auto& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+        frames_ = 0;
+        for (unsigned int w{ 0 }; w < threads_; ++w) {
+            frames_ += worker_frames[w];
+            for (std::size_t i{ 0 }; i < results.size(); ++i) {
+                update(results[i], worker_results[w][i].best_score, worker_results[w][i].best_frame);
+            }
+        }
+        return results;
+    }
+
+    std::size_t getFrames() const {
+        return frames_;
+    }
+
+    double getFps() const {
+        return elapsed_.count() > 0 ? frames_ / elapsed_.count() : 0.0;
+    }
+
+    double getDecodeFps() const {
+        return decode_fps_;
+    }
+
+    const std::vector<cv::Rect>& getRois() const {
+        return rois_;
+    }
+
+    /// <summary>
+    /// Scores for every ROI and metric, in the same order as results of process
+    /// </summary>
+    std::vector<double> scoreFrame(const cv::Mat& frame) const {
+        return scoreRois(frame, rois_, metrics_);
+    }
+
+    /// <summary>
+    /// Scores for every ROI and metric, ROI-major order
+    /// </summary>
+    /// <param name="frame">BGR frame</param>
+    /// <param name="rois">Regions of the frame</param>
+    /// <param name="metrics">Focus metrics</param>
+    /// <param name="scale">Gray ROIs are downscaled by this factor before scoring</param>
+    static std::vector<double> scoreRois(const cv::Mat& frame, const std::vector<cv::Rect>& rois,
+        const std::vector<FocusMetric>& metrics, double scale = 1.0) {
+        std::vector<double> scores;
+        scores.reserve(rois.size() * metrics.size());
+        cv::Mat gray, small;
+        for (const auto& roi : rois) {
+            // Only ROI is converted, the frame itself is never copied
+            cv::cvtColor(frame(roi), gray, cv::COLOR_BGR2GRAY);
+            if (scale < 1.0) {
+                cv::resize(gray, small, {}, scale, scale, cv::INTER_AREA);
+                std::swap(gray, small);
+            }
+            for (auto metric : metrics) {
+                scores.push_back(focusScore(gray, metric));
+            }
+        }
+        return scores;
+    }
+
+private:
+    std::vector<cv::Rect> rois_;
+    std::vector<FocusMetric> metrics_;
+    unsigned int threads_;
+
+    /// <summary>
+    /// Keeps the better score, workers see frames out of order so the earlier frame wins a tie like in a sequential scan
+    /// </summary>
+    static void update(FocusResult& result, double score, std::size_t index) {
+        if (score > result.best_score || (score == result.best_score && index < result.best_frame)) {
+            result.best_score = score;
+            result.best_frame = index;
+        }
+    }
+
+    static void update(std::vector<FocusResult>& results, const std::vector<double>& scores, std::size_t index) {
+        for (std::size_t i{ 0 }; i < scores.size(); ++i) {
+            update(results[i], scores[i], index);
+        }
+    }
+
+    // Statistics
+    std::size_t frames_{ 0 };
+    std::chrono::duration<double> elapsed_{ 0 };
+    double decode_fps_{ 0 };
+};
+
+/// <summary>
+/// Coarse-to-fine search of the best focused frame in a long focus sweep.
+/// Coarse pass decodes only every n-th frame, seeking over the frames in between, and scores it at reduced resolution.
+/// Fine pass decodes and scores at full resolution only frames around the coarse peak of every ROI and metric,
+/// coarse frames which are still peaks are kept from the coarse pass and not read again.
+/// Assumes the focus curve is unimodal on the scale of the coarse step.
+/// </summary>
+class FocusSweepSearch {
+public:
+    /// <summary>
+    /// Creates the search
+    /// </summary>
+    /// <param name="rois">Regions of the frame scored separately</param>
+    /// <param name="metrics">Focus metrics computed for every ROI</param>
+    /// <param name="step">Distance between frames of the coarse pass</param>
+    /// <param name="coarse_scale">Resolution of the coarse pass relative to the video</param>
+    /// <param name="max_grab">Forward gaps up to this many frames are skipped with grab() instead of a seek, always less than step</param>
+    FocusSweepSearch(std::vector<cv::Rect> rois, std::vector<FocusMetric> metrics, int step = 8, double coarse_scale = 0.25, int max_grab = 2)
+        : rois_(std::move(rois)), metrics_(std::move(metrics)), step_(std::max(step, 1)), coarse_scale_(std::clamp(coarse_scale, 0.01, 1.0)),
+        max_grab_(static_cast<std::size_t>(std::clamp(max_grab, 0, std::max(step, 1) - 1))) {
+        if (rois_.empty() || metrics_.empty()) {
+            throw std::runtime_error("At least one ROI and one metric are needed!\n");
+        }
+    }
+
+    std::vector<FocusResult> process(const std::string& path) {
+        cv::VideoCapture cap(path);
+        if (!cap.isOpened()) {
+            throw std::runtime_error(std::format("Can't load video from {}", path));
+        }
+        total_frames_ = static_cast<std::size_t>(std::max(cap.get(cv::CAP_PROP_FRAME_COUNT), 0.0));
+        read_frames_ = 0;
+        grabbed_frames_ = 0;
+        scored_frames_ = 0;
+        seeks_ = 0;
+        decode_time_ = {};
+        next_index_ = 0;
+
+        std::vector<FocusResult> results;
+        for (std::size_t r{ 0 }; r < rois_.size(); ++r) {
+            for (auto metric : metrics_) {
+                results.push_back({ r, metric });
+            }
+        }
+
+        // 1. Coarse pass - every step-th frame at reduced resolution, full resolution frames of current peaks are kept
+        cv::Mat frame;
+        std::map<std::size_t, cv::Mat> peaks;
+        std::size_t last_index{ 0 };
+        for (std::size_t index{ 0 }; total_frames_ == 0 || index < total_frames_; index += step_) {
+            if (!decodeFrame(cap, index, &frame)) {
+                break;
+            }
+            last_index = index;
+            auto scores{ FocusScoringEngine::scoreRois(frame, rois_, metrics_, coarse_scale_) };
+            ++scored_frames_;
+            if (update(results, scores, index)) {
+                peaks[index] = frame.clone();
+                std::erase_if(peaks, [&results](const auto& peak) {
+                    return std::ranges::none_of(results, [&peak](const FocusResult& result) { return result.best_frame == peak.first; });
+                    });
+            }
+        }
+        if (total_frames_ == 0) {
+            total_frames_ = last_index + 1;
+        }
+
+        // 2. Fine pass - full resolution around every coarse peak, overlapping windows are decoded once
+        std::vector<cv::Range> windows;
+        for (const auto& result : results) {
+            windows.emplace_back(static_cast<int>(result.best_frame > step_ ? result.best_frame - step_ + 1 : 0),
+                static_cast<int>(std::min(result.best_frame + step_, total_frames_)));
+        }
+        const auto result_windows{ windows };
+        std::ranges::sort(windows, {}, &cv::Range::start);
+
+        std::vector<cv::Range> merged;
+        for (const auto& window : windows) {
+            if (!merged.empty() && window.start <= merged.back().end) {
+                merged.back().end = std::max(merged.back().end, window.end);
+            }
+            else {
+                merged.push_back(window);
+            }
+        }
+
+        for (auto& result : results) {
+            result.best_score = -std::numeric_limits<double>::infinity();
+        }
+
+        for (const auto& window : merged) {
+            for (int index{ window.start }; index < window.end; ++index) {
+                // Peak frame from the coarse pass only has to be stepped over, the stream is sequential
+                auto peak{ peaks.find(static_cast<std::size_t>(index)) };
+                const bool kept{ peak != peaks.end() };
+                if (!decodeFrame(cap, index, kept ? nullptr : &frame)) {
+                    break;
+                }
+                auto scores{ FocusScoringEngine::scoreRois(kept ? peak->second : frame, rois_, metrics_) };
+                ++scored_frames_;
+                for (std::size_t i{ 0 }; i < scores.size(); ++i) {
+                    // Every ROI and metric is refined only inside its own window
+                    if (index >= result_windows[i].start && index < result_windows[i].end && scores[i] > results[i].best_score) {
+                        results[i].best_score = scores[i];
+                        results[i].best_frame = index;
+                    }
+                }
+            }
+        }
+
+        return results;
+    }
+
+    /// <summary>
+    /// Frames decoded by read() or grab(). Every seek also decodes frames from the previous keyframe,
+    /// those aren't visible here, getDecodeSeconds includes them.
+    /// </summary>
+    std::size_t getDecodedFrames() const {
+        return read_frames_ + grabbed_frames_;
+    }
+
+    std::size_t getScoredFrames() const {
+        return scored_frames_;
+    }
+
+    std::size_t getSeeks() const {
+        return seeks_;
+    }
+
+    /// <summary>
+    /// Time spent in read(), grab() and seeking
+    /// </summary>
+    double getDecodeSeconds() const {
+        return decode_time_.count();
+    }
+
+    std::size_t getTotalFrames() const {
+        return total_frames_;
+    }
+
+private:
+    std::vector<cv::Rect> rois_;
+    std::vector<FocusMetric> metrics_;
+    std::size_t step_;
+    double coarse_scale_;
+    std::size_t max_grab_;
+
+    std::size_t total_frames_{ 0 };
+    std::size_t read_frames_{ 0 };
+    std::size_t grabbed_frames_{ 0 };
+    std::size_t scored_frames_{ 0 };
+    std::size_t seeks_{ 0 };
+    std::chrono::duration<double> decode_time_{};
+    std::size_t next_index_{ 0 };
+
+    /// <summary>
+    /// Decodes frame with given index, the frame is retrieved only if the output isn't null
+    /// </summary>
+    bool decodeFrame(cv::VideoCapture& cap, std::size_t index, cv::Mat* frame) {
+        auto start{ std::chrono::steady_clock::now() };
+        bool decoded{ moveTo(cap, index) && (frame ? cap.read(*frame) && !frame->empty() : cap.grab()) };
+        decode_time_ += std::chrono::steady_clock::now() - start;
+        if (!decoded) {
+            return false;
+        }
+        ++(frame ? read_frames_ : grabbed_frames_);
+        next_index_ = index + 1;
+        return true;
+    }
+
+    /// <summary>
+    /// Positions the stream at given index, gaps up to max_grab_ frames are grabbed, anything else is a seek
+    /// </summary>
+    bool moveTo(cv::VideoCapture& cap, std::size_t index) {
+        if (index > next_index_ && index - next_index_ <= max_grab_) {
+            for (; next_index_ < index; ++next_index_) {
+                if (!cap.grab()) {
+                    return false;
+                }
+                ++grabbed_frames_;
+            }
+        }
+        else if (index != next_index_) {
+            cap.set(cv::CAP_PROP_POS_FRAMES, static_cast<double>(index));
+            ++seeks_;
+        }
+        return true;
+    }
+
+    /// <summary>
+    /// Keeps the better scores, returns true if any of them is new
+    /// </summary>
+    static bool update(std::vector<FocusResult>& results, const std::vector<double>& scores, std::size_t index) {
+        bool updated{ false };
+        for (std::size_t i{ 0 }; i < scores.size(); ++i) {
+            if (scores[i] > results[i].best_score) {
+                results[i].best_score = scores[i];
+                results[i].best_frame = index;
+                updated = true;
+            }
+        }
+        return updated;
+    }
+};
@@ -7,6 +7,93 @@
 #include <vector>
 #include <numbers>
 #include <ranges>
+#include <print>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include "hough_lines.hpp"
+#include "../../common/timing.hpp"
+
+/// <summary>
+/// Agreement of segments with reference segments
+/// </summary>
+struct Agreement {
+    // Pixels of the segments within 2 pixels of a reference segment
+    double overlap{ 0 };
+    // Segments whose both endpoints are within 5 pixels of the endpoints of one reference segment
+    double endpoints{ 0 };
+    // Pixels of segments drawn one by one over pixels of their union, 1 means no segment repeats another
+    double redundancy{ 0 };
+};
+
+Agreement compare(const std::vector<cv::Vec4i>& lines, const std::vector<cv::Vec4i>& reference, cv::Size size) {
+    Agreement agreement;
+    if (lines.empty()) {
+        return agreement;
+    }
+
+    cv::Mat reference_mask{ cv::Mat::zeros(size, CV_8U) };
+    for (const auto& line : reference) {
+        cv::line(reference_mask, { line[0], line[1] }, { line[2], line[3] }, cv::Scalar(255), 5);
+    }
+    cv::Mat mask{ cv::Mat::zeros(size, CV_8U) };
+    double drawn{ 0 };
+    for (const auto& line : lines) {
+        drawn += cv::LineIterator(mask, { line[0], line[1] }, { line[2], line[3] }).count;
+        cv::line(mask, { line[0], line[1] }, { line[2], line[3] }, cv::Scalar(255), 1);
+    }
+    cv::Mat on_reference;
+    cv::bitwise_and(mask, reference_mask, on_reference);
+    const double drawn_union{ static_cast<double>(cv::countNonZero(mask)) };
+    agreement.overlap = cv::countNonZero(on_reference) / drawn_union;
+    agreement.redundancy = drawn / drawn_union;
+
+    auto close = [](int x0, int y0, int x1, int y1) {
+        return std::hypot(x0 - x1, y0 - y1) <= 5;
+        };
+    auto matched{ std::ranges::count_if(lines, [&](const cv::Vec4i& line) {
+        return std::ranges::any_of(reference, [&](const cv::Vec4i& other) {
+            return (close(line[0], line[1], other[0], other[1]) && close(line[2], line[3], other[2], other[3]))
+                || (close(line[0], line[1], other[2], other[3]) && close(line[2], line[3], other[0], other[1]));
+            });
+        }) };
+    agreement.endpoints = static_cast<double>(matched) / lines.size();
+    return agreement;
+}
+
+/// <summary>
+/// Lines per second of cv::HoughLinesP, HoughLineDetector on single images and in temporal mode, and agreement
+/// of the detector's segments with cv::HoughLinesP. The edge image is repeated as frames of a video.
+/// </summary>
+void benchmark(const cv::Mat& edges) {
+    constexpr int frames{ 30 };
+    std::vector<cv::Vec4i> reference, lines;
+    auto report = [&](const std::string& name, double ms) {
+        std::println("{:<34} {:>8.2f} ms/frame {:>5} lines {:>10.0f} lines/s", name, ms, lines.size(), lines.size() * 1000.0 / ms);
+        };
+    auto agree = [&](const std::string& name) {
+        const auto agreement{ compare(lines, reference, edges.size()) };
+        std::println("{:<34} overlap {:>5.1f}%, endpoints {:>5.1f}%, redundancy {:.2f}",
+            name, 100 * agreement.overlap, 100 * agreement.endpoints, agreement.redundancy);
+        };
+
+    double cv_ms{ measureMs([&] { cv::HoughLinesP(edges, lines, 1, std::numbers::pi / 180, 100, 10, 250); }, frames) };
+    report("HoughLinesP", cv_ms);
+    reference = lines;
+    agree("  HoughLinesP itself");
+
+    HoughLineDetector detector{ 1, std::numbers::pi / 180, 100, 10, 250 };
+    double detect_ms{ measureMs([&] { lines = detector.detect(edges); }, frames) };
+    report("HoughLineDetector::detect", detect_ms);
+    agree("  vs HoughLinesP");
+
+    detector.detect(edges);
+    double track_ms{ measureMs([&] { lines = detector.track(edges); }, frames) };
+    report(std::format("HoughLineDetector::track ({} angles)", detector.getVotedAngles()), track_ms);
+    agree("  vs HoughLinesP");
+    std::println("track is timed on the same edge image every frame, so every line is where the previous frame left it;");
+    std::println("on a real video lines move out of the windows and full detections run more often, expect less speedup");
+}
 
 int main() {
     // Path to an image 
@@ -35,8 +122,17 @@ int main() {
     // Detect points in the image
     std::vector<cv::Vec4i> lines;
 
-    // Find line only if 100 pixels voted on that
-    cv::HoughLinesP(edges, lines, 1, std::numbers::pi / 180, 100, 10, 250);
+    // Find line only if 100 pixels voted on that, the same parameters as cv::HoughLinesP(edges, lines, 1, pi / 180, 100, 10, 250)
+    try {
+        HoughLineDetector detector{ 1, std::numbers::pi / 180, 100, 10, 250 };
+        lines = detector.detect(edges);
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    benchmark(edges);
 
     // Draw lines on the image
     std::ranges::for_each(lines, [&img](const auto& line) {
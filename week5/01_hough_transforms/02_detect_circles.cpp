@@ -7,6 +7,46 @@
 #include <vector>
 #include <numbers>
 #include <ranges>
+#include <print>
+#include "hough_circles.hpp"
+#include "../../common/timing.hpp"
+
+/// <summary>
+/// Time per megapixel of cv::HoughCircles (one call per band) and HoughCircleDetector (all bands at once).
+/// For the detector also the pixels which went through Sobel and Canny, the votes cast and the edge points read
+/// by the voting bands, relative to the full resolution search, show what the coarse pass saves.
+/// </summary>
+void benchmark(const cv::Mat& blurred, const std::vector<RadiusBand>& bands, const std::string& name) {
+    constexpr int repetitions{ 5 };
+    const double megapixels{ blurred.total() / 1e6 };
+
+    std::size_t cv_count{ 0 };
+    double cv_ms{ measureMs([&] {
+        cv_count = 0;
+        for (const auto& band : bands) {
+            std::vector<cv::Vec3f> circles;
+            cv::HoughCircles(blurred, circles, cv::HOUGH_GRADIENT, 1, 50, 450, 10, band.min_radius, band.max_radius);
+            cv_count += circles.size();
+        }
+        }, repetitions) };
+
+    std::println("{} ({} bands, {:.2f} MP):", name, bands.size(), megapixels);
+    std::println("    {:<28} {:>10.2f} ms/MP {:>6} circles", "HoughCircles", cv_ms / megapixels, cv_count);
+    HoughCircleWork full;
+    for (double scale : { 1.0, 0.5 }) {
+        HoughCircleDetector detector{ 1, 50, 450, 10, scale };
+        std::size_t count{ 0 };
+        HoughCircleWork work;
+        double ms{ measureMs([&] { count = detector.detect(blurred, bands, {}, &work).size(); }, repetitions) };
+        if (scale == 1.0) {
+            full = work;
+        }
+        std::println("    {:<28} {:>10.2f} ms/MP {:>6} circles, edges on {:>5.1f}% of pixels, {:>5.1f}% of votes, {:>5.1f}% of edge reads",
+            std::format("HoughCircleDetector x{}", scale), ms / megapixels, count,
+            100.0 * work.edge_pixels / std::max<std::size_t>(1, full.edge_pixels), 100.0 * work.votes / std::max<std::size_t>(1, full.votes),
+            100.0 * work.scans / std::max<std::size_t>(1, full.scans));
+    }
+}
 
 int main() {
     // Path to an image 
@@ -32,9 +72,19 @@ int main() {
     cv::Mat blurred;
     cv::medianBlur(gray, blurred, 5);
 
-    // Find circles
+    // Find circles, the same parameters as cv::HoughCircles(blurred, circles, cv::HOUGH_GRADIENT, 1, 50, 450, 10, 30, 40)
     std::vector<cv::Vec3f> circles;
-    cv::HoughCircles(blurred, circles, cv::HOUGH_GRADIENT, 1, 50, 450, 10, 30, 40);
+    try {
+        HoughCircleDetector detector{ 1, 50, 450, 10 };
+        circles = HoughCircleDetector::toVec3f(detector.detect(blurred, { { 30, 40 } }));
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    benchmark(blurred, { { 30, 40 } }, "Single band");
+    benchmark(blurred, { { 10, 20 }, { 20, 30 }, { 30, 40 }, { 40, 60 }, { 60, 90 } }, "Coin radii");
 
     std::ranges::for_each(circles, [&img](const auto& circle) {
         cv::circle(img, 
@@ -0,0 +1,521 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <stdexcept>
+#include <format>
+#include <vector>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <atomic>
+#include <cmath>
+
+/// <summary>
+/// Range of radii searched together, both ends included
+/// </summary>
+struct RadiusBand {
+    int min_radius;
+    int max_radius;
+};
+
+/// <summary>
+/// Circle found by HoughCircleDetector, votes are the value of the centre in the accumulator
+/// </summary>
+struct HoughCircle {
+    cv::Point2f center;
+    float radius;
+    int votes;
+};
+
+/// <summary>
+/// Work done by HoughCircleDetector::detect over all passes, shows what the coarse pass saves
+/// </summary>
+struct HoughCircleWork {
+    // Pixels which went through Sobel and Canny
+    std::size_t edge_pixels{ 0 };
+    // Votes cast into accumulators
+    std::size_t votes{ 0 };
+    // Edge points read by the voting bands of accumulators, every band reads only edges which can reach its rows
+    std::size_t scans{ 0 };
+};
+
+/// <summary>
+/// Hough gradient circle detector for many radius bands and regions of interest:
+///     - Sobel derivatives and Canny edges are computed once per scale, only around the regions which are searched,
+///       edge points are kept with unit gradient direction in a grid of cells, so a task reads only nearby edges
+///     - every (ROI, band) pair is a task, tasks run in parallel in waves whose accumulators fit into a memory budget
+///     - a task has a single accumulator, its rows are split into bands and every band is voted by one worker,
+///       so there are no atomics and nothing to merge; edges are bucketed by the bands they can reach, so voting
+///       costs edges times radii, not edges times image height
+///     - centres are local maxima above the vote threshold, the radius is the most supported distance to edge points
+///     - with coarse_scale < 1 the image is searched first at reduced size, then only small windows around coarse
+///       circles are searched at full resolution with narrow radius bands
+/// Parameters follow cv::HoughCircles with HOUGH_GRADIENT (dp, minDist, param1 as Canny threshold, param2 as votes).
+/// </summary>
+class HoughCircleDetector {
+public:
+    HoughCircleDetector(double dp = 1, double min_dist = 20, int canny_threshold = 100, int votes_threshold = 20, double coarse_scale = 1.0)
+        : dp_(dp), min_dist_(min_dist), canny_threshold_(canny_threshold), votes_threshold_(votes_threshold), coarse_scale_(coarse_scale) {
+        if (dp < 1 || min_dist <= 0 || canny_threshold <= 0 || votes_threshold <= 0 || coarse_scale <= 0 || coarse_scale > 1) {
+            throw std::runtime_error(std::format("Wrong Hough circle parameters: dp {}, min dist {}, canny {}, votes {}, scale {}\n",
+                dp, min_dist, canny_threshold, votes_threshold, coarse_scale));
+        }
+    }
+
+    /// <param name="gray">8-bit single channel image, usually blurred</param>
+    /// <param name="bands">Radius bands, searched independently</param>
+    /// <param name="rois">Regions where centres are searched, empty means the whole image</param>
+    /// <param name="work">If not null, receives the work done by all passes</param>
+    /// <returns>Circles sorted by votes, at least min_dist apart</returns>
+    std::vector<HoughCircle> detect(const cv::Mat& gray, const std::vector<RadiusBand>& bands, const std::vector<cv::Rect>& rois = {}, HoughCircleWork* work = nullptr) const {
+        if (gray.empty() || gray.type() != CV_8U) {
+            throw std::runtime_error("Hough circle detector works only with single channel 8-bit images!\n");
+        }
+        for (const auto& band : bands) {
+            if (band.min_radius < 1 || band.max_radius < band.min_radius) {
+                throw std::runtime_error(std::format("Wrong radius band [{}, {}]\n", band.min_radius, band.max_radius));
+            }
+        }
+
+        const cv::Rect image(0, 0, gray.cols, gray.rows);
+        std::vector<cv::Rect> regions;
+        for (const auto& roi : rois.empty() ? std::vector<cv::Rect>{ image } : rois) {
+            if (auto clipped{ roi & image }; !clipped.empty()) {
+                regions.push_back(clipped);
+            }
+        }
+
+        HoughCircleWork total;
+        std::vector<Task> tasks;
+        if (coarse_scale_ < 1) {
+            tasks = refinementTasks(gray, bands, regions, total);
+        }
+        else {
+            for (const auto& region : regions) {
+                for (const auto& band : bands) {
+                    tasks.push_back({ region, band });
+                }
+            }
+        }
+        auto circles{ search(gray, tasks, 1.0, total) };
+        if (work) {
+            *work = total;
+        }
+        return circles;
+    }
+
+    /// <summary>
+    /// Circles in the format of cv::HoughCircles
+    /// </summary>
+    static std::vector<cv::Vec3f> toVec3f(const std::vector<HoughCircle>& circles) {
+        std::vector<cv::Vec3f> result;
+        result.reserve(circles.size());
+        for (const auto& circle : circles) {
+            result.emplace_back(circle.center.x, circle.center.y, circle.radius);
+        }
+        return result;
+    }
+
+private:
+    struct EdgePoint {
+        float x;
+        float y;
+        // Unit gradient direction
+        float dx;
+        float dy;
+    };
+
+    struct Task {
+        cv::Rect roi;
+        RadiusBand band;
+    };
+
+    /// <summary>
+    /// Edge points sorted into square cells, built once per search
+    /// </summary>
+    class EdgeGrid {
+    public:
+        EdgeGrid(const std::vector<EdgePoint>& points, cv::Size size, int cell)
+            : cell_(cell), cols_((size.width + cell - 1) / cell), rows_((size.height + cell - 1) / cell), starts_(cols_ * rows_ + 1, 0), points_(points.size()) {
+            // Counting sort by cell
+            for (const auto& point : points) {
+                ++starts_[index(point) + 1];
+            }
+            std::partial_sum(starts_.begin(), starts_.end(), starts_.begin());
+            std::vector<int> next(starts_.begin(), starts_.end() - 1);
+            for (const auto& point : points) {
+                points_[next[index(point)]++] = point;
+            }
+        }
+
+        /// <summary>
+        /// Edge points with left <= x < right and top <= y < bottom
+        /// </summary>
+        std::vector<EdgePoint> query(float left, float top, float right, float bottom) const {
+            std::vector<EdgePoint> result;
+            const int x0{ std::clamp(static_cast<int>(std::floor(left / cell_)), 0, cols_ - 1) };
+            const int x1{ std::clamp(static_cast<int>(std::floor(right / cell_)), 0, cols_ - 1) };
+            const int y0{ std::clamp(static_cast<int>(std::floor(top / cell_)), 0, rows_ - 1) };
+            const int y1{ std::clamp(static_cast<int>(std::floor(bottom / cell_)), 0, rows_ - 1) };
+            for (int cy{ y0 }; cy <= y1; ++cy) {
+                for (int cx{ x0 }; cx <= x1; ++cx) {
+                    const int c{ cy * cols_ + cx };
+                    for (int i{ starts_[c] }; i < starts_[c + 1]; ++i) {
+                        const auto& point{ points_[i] };
+                        if (point.x >= left && point.x < right && point.y >= top && point.y < bottom) {
+                            result.push_back(point);
+                        }
+                    }
+                }
+            }
+            return result;
+        }
+
+    private:
+        int cell_;
+        int cols_;
+        int rows_;
+        std::vector<int> starts_;
+        std::vector<EdgePoint> points_;
+
+        int index(const EdgePoint& point) const {
+            return static_cast<int>(point.y) / cell_ * cols_ + static_cast<int>(point.x) / cell_;
+        }
+    };
+
+    // Accumulators of tasks running at the same time share this budget, a task larger than it runs alone
+    static constexpr std::size_t accumulator_budget_{ 256 * 1024 * 1024 };
+
+    double dp_;
+    double min_dist_;
+    int canny_threshold_;
+    int votes_threshold_;
+    double coarse_scale_;
+
+    /// <summary>
+    /// Edge points with gradient direction inside the areas, bands of rows are collected in parallel.
+    /// Sobel reads pixels around an area from the image, Canny hysteresis is limited to the area.
+    /// </summary>
+    std::vector<EdgePoint> extractEdges(const cv::Mat& gray, const std::vector<cv::Rect>& areas) const {
+        constexpr int band_rows{ 32 };
+        struct Band {
+            cv::Rect area;
+            int index;
+        };
+        std::vector<cv::Mat> dxs(areas.size()), dys(areas.size()), edge_maps(areas.size());
+        std::vector<Band> bands;
+        for (int a{ 0 }; a < static_cast<int>(areas.size()); ++a) {
+            for (int y{ 0 }; y < areas[a].height; y += band_rows) {
+                bands.push_back({ cv::Rect(0, y, areas[a].width, std::min(band_rows, areas[a].height - y)), a });
+            }
+        }
+
+        std::vector<int> indices(areas.size());
+        std::iota(indices.begin(), indices.end(), 0);
+        std::for_each(std::execution::par, indices.begin(), indices.end(), [&](int a) {
+            cv::Mat area{ gray(areas[a]) };
+            cv::Sobel(area, dxs[a], CV_16S, 1, 0, 3);
+            cv::Sobel(area, dys[a], CV_16S, 0, 1, 3);
+            cv::Canny(dxs[a], dys[a], edge_maps[a], std::max(1, canny_threshold_ / 2), canny_threshold_, false);
+            });
+
+        std::vector<std::vector<EdgePoint>> found(bands.size());
+        indices.resize(bands.size());
+        std::iota(indices.begin(), indices.end(), 0);
+        std::for_each(std::execution::par, indices.begin(), indices.end(), [&](int b) {
+            const auto& [rows, a] = bands[b];
+            const cv::Point offset{ areas[a].tl() };
+            for (int y{ rows.y }; y < rows.y + rows.height; ++y) {
+                const uchar* edge{ edge_maps[a].ptr<uchar>(y) };
+                const short* gx{ dxs[a].ptr<short>(y) };
+                const short* gy{ dys[a].ptr<short>(y) };
+                for (int x{ 0 }; x < rows.width; ++x) {
+                    if (!edge[x]) {
+                        continue;
+                    }
+                    const float magnitude{ std::sqrt(static_cast<float>(gx[x]) * gx[x] + static_cast<float>(gy[x]) * gy[x]) };
+                    if (magnitude > 0) {
+                        found[b].push_back({ static_cast<float>(x + offset.x), static_cast<float>(y + offset.y), gx[x] / magnitude, gy[x] / magnitude });
+                    }
+                }
+            }
+            });
+
+        std::vector<EdgePoint> points;
+        for (const auto& band : found) {
+            points.insert(points.end(), band.begin(), band.end());
+        }
+        return points;
+    }
+
+    /// <summary>
+    /// Disjoint rectangles covering every pixel which can vote for a centre of some task
+    /// </summary>
+    static std::vector<cv::Rect> reach(const std::vector<Task>& tasks, cv::Size size) {
+        const cv::Rect image(0, 0, size.width, size.height);
+        std::vector<cv::Rect> areas;
+        for (const auto& [roi, band] : tasks) {
+            const int margin{ band.max_radius + 1 };
+            if (auto area{ cv::Rect(roi.x - margin, roi.y - margin, roi.width + 2 * margin, roi.height + 2 * margin) & image }; !area.empty()) {
+                areas.push_back(area);
+            }
+        }
+        // Overlapping rectangles are replaced by their bounding box until none overlap
+        for (bool merged{ true }; merged;) {
+            merged = false;
+            for (std::size_t i{ 0 }; i < areas.size() && !merged; ++i) {
+                for (std::size_t j{ i + 1 }; j < areas.size(); ++j) {
+                    if (!(areas[i] & areas[j]).empty()) {
+                        areas[i] |= areas[j];
+                        areas.erase(areas.begin() + j);
+                        merged = true;
+                        break;
+                    }
+                }
+            }
+        }
+        return areas;
+    }
+
+    /// <summary>
+    /// Runs every task on the edges of an image, coordinates of found circles are divided by scale
+    /// </summary>
+    std::vector<HoughCircle> search(const cv::Mat& gray, const std::vector<Task>& tasks, double scale, HoughCircleWork& work) const {
+        const auto areas{ reach(tasks, gray.size()) };
+        for (const auto& area : areas) {
+            work.edge_pixels += area.area();
+        }
+        const EdgeGrid grid(extractEdges(gray, areas), gray.size(), 32);
+
+        // Waves of tasks whose accumulators fit into the budget together
+        std::vector<std::vector<HoughCircle>> found(tasks.size());
+        std::atomic<std::size_t> votes{ 0 };
+        std::atomic<std::size_t> scans{ 0 };
+        for (std::size_t begin{ 0 }; begin < tasks.size();) {
+            std::size_t end{ begin }, bytes{ 0 };
+            do {
+                bytes += accumulatorSize(tasks[end].roi).area() * sizeof(int);
+                ++end;
+            } while (end < tasks.size() && bytes + accumulatorSize(tasks[end].roi).area() * sizeof(int) <= accumulator_budget_);
+
+            std::vector<int> indices(end - begin);
+            std::iota(indices.begin(), indices.end(), static_cast<int>(begin));
+            std::for_each(std::execution::par, indices.begin(), indices.end(), [&](int t) {
+                found[t] = searchTask(grid, tasks[t], min_dist_ * scale, std::max(1, static_cast<int>(std::lround(votes_threshold_ * scale))), votes, scans);
+                });
+            begin = end;
+        }
+        work.votes += votes;
+        work.scans += scans;
+
+        std::vector<HoughCircle> circles;
+        for (auto& task_circles : found) {
+            for (auto& circle : task_circles) {
+                circle.center.x = static_cast<float>(circle.center.x / scale);
+                circle.center.y = static_cast<float>(circle.center.y / scale);
+                circle.radius = static_cast<float>(circle.radius / scale);
+                circles.push_back(circle);
+            }
+        }
+        // Bands and ROIs overlap, the strongest circle of every neighbourhood survives
+        return suppress(std::move(circles), min_dist_);
+    }
+
+    cv::Size accumulatorSize(const cv::Rect& roi) const {
+        return { static_cast<int>(std::ceil(roi.width / dp_)), static_cast<int>(std::ceil(roi.height / dp_)) };
+    }
+
+    std::vector<HoughCircle> searchTask(const EdgeGrid& grid, const Task& task, double min_dist, int votes_threshold,
+        std::atomic<std::size_t>& total_votes, std::atomic<std::size_t>& total_scans) const {
+        const auto& [roi, band] = task;
+
+        // Only edges closer than the largest radius to the ROI can vote for its centres
+        const auto edges{ grid.query(static_cast<float>(roi.x - band.max_radius), static_cast<float>(roi.y - band.max_radius),
+            static_cast<float>(roi.x + roi.width + band.max_radius), static_cast<float>(roi.y + roi.height + band.max_radius)) };
+        if (edges.empty()) {
+            return {};
+        }
+
+        // 1. Voting, every band of accumulator rows is written by one worker. An edge point votes in a band only
+        //    with the radii whose centres fall into the band rows
+        const cv::Size size{ accumulatorSize(roi) };
+        cv::Mat accumulator{ cv::Mat::zeros(size, CV_32S) };
+        constexpr int band_rows{ 16 };
+        const int n_bands{ (size.height + band_rows - 1) / band_rows };
+        const double inv_dp{ 1.0 / dp_ };
+
+        // Centres of an edge lie min..max radius times |dy| above and below it, the edge goes only to the bands
+        // of these two row ranges, one extra row on each side covers rounding
+        std::vector<std::vector<int>> band_edges(n_bands);
+        auto bandOf = [&](double y, int extra) {
+            return std::clamp((static_cast<int>(std::floor((y - roi.y) * inv_dp)) + extra) / band_rows, 0, n_bands - 1);
+        };
+        std::size_t scans{ 0 };
+        for (int e{ 0 }; e < static_cast<int>(edges.size()); ++e) {
+            const auto& edge{ edges[e] };
+            const double near{ band.min_radius * std::abs(edge.dy) };
+            const double far{ band.max_radius * std::abs(edge.dy) };
+            int previous{ -1 };
+            for (const auto& [low, high] : { std::pair{ edge.y - far, edge.y - near }, std::pair{ edge.y + near, edge.y + far } }) {
+                if (high < roi.y - dp_ || low >= roi.y + (size.height + 1) * dp_) {
+                    continue;
+                }
+                const int last{ bandOf(high, 1) };
+                for (int b{ std::max(bandOf(low, -1), previous + 1) }; b <= last; ++b) {
+                    band_edges[b].push_back(e);
+                    ++scans;
+                }
+                previous = std::max(previous, last);
+            }
+        }
+        total_scans += scans;
+
+        std::vector<int> row_bands(n_bands);
+        std::iota(row_bands.begin(), row_bands.end(), 0);
+        std::for_each(std::execution::par, row_bands.begin(), row_bands.end(), [&](int b) {
+            const int first{ b * band_rows };
+            const int last{ std::min(first + band_rows, size.height) };
+            const double top{ roi.y + first * dp_ };
+            const double bottom{ roi.y + last * dp_ };
+            std::size_t votes{ 0 };
+            for (int e : band_edges[b]) {
+                const auto& edge{ edges[e] };
+                for (int sign : { -1, 1 }) {
+                    // Centre row is linear in the radius, radii of this band are solved for, one extra on each side
+                    // covers rounding, the exact check is done per vote
+                    const double step{ sign * edge.dy };
+                    int r_min{ band.min_radius }, r_max{ band.max_radius };
+                    if (std::abs(step) > 1e-6) {
+                        const double r0{ std::clamp((top - edge.y) / step, band.min_radius - 1.0, band.max_radius + 1.0) };
+                        const double r1{ std::clamp((bottom - edge.y) / step, band.min_radius - 1.0, band.max_radius + 1.0) };
+                        r_min = std::max(r_min, static_cast<int>(std::floor(std::min(r0, r1))) - 1);
+                        r_max = std::min(r_max, static_cast<int>(std::ceil(std::max(r0, r1))) + 1);
+                    }
+                    else if (edge.y < top || edge.y >= bottom) {
+                        continue;
+                    }
+                    for (int r{ r_min }; r <= r_max; ++r) {
+                        const int x{ static_cast<int>(std::floor((edge.x + sign * r * edge.dx - roi.x) * inv_dp)) };
+                        const int y{ static_cast<int>(std::floor((edge.y + sign * r * edge.dy - roi.y) * inv_dp)) };
+                        if (x >= 0 && y >= first && x < size.width && y < last) {
+                            ++accumulator.at<int>(y, x);
+                            ++votes;
+                        }
+                    }
+                }
+            }
+            total_votes += votes;
+            });
+
+        // 2. Local maxima above the threshold, strongest first
+        std::vector<HoughCircle> centers;
+        for (int y{ 1 }; y < size.height - 1; ++y) {
+            const int* previous{ accumulator.ptr<int>(y - 1) };
+            const int* row{ accumulator.ptr<int>(y) };
+            const int* next{ accumulator.ptr<int>(y + 1) };
+            for (int x{ 1 }; x < size.width - 1; ++x) {
+                const int votes{ row[x] };
+                if (votes > votes_threshold && votes > row[x - 1] && votes >= row[x + 1] && votes > previous[x] && votes >= next[x]) {
+                    centers.push_back({ cv::Point2f(static_cast<float>(roi.x + (x + 0.5) * dp_), static_cast<float>(roi.y + (y + 0.5) * dp_)), 0, votes });
+                }
+            }
+        }
+        accumulator.release();
+        centers = suppress(std::move(centers), min_dist);
+
+        // 3. Radius of every centre, the distance shared by most edge points relative to the circumference
+        std::vector<int> positions(centers.size());
+        std::iota(positions.begin(), positions.end(), 0);
+        std::vector<char> accepted(centers.size(), 0);
+        std::for_each(std::execution::par, positions.begin(), positions.end(), [&](int c) {
+            auto& center{ centers[c] };
+            const float extent{ band.max_radius + 1.0f };
+            std::vector<int> counts(band.max_radius - band.min_radius + 1, 0);
+            for (const auto& edge : grid.query(center.center.x - extent, center.center.y - extent, center.center.x + extent, center.center.y + extent)) {
+                const int r{ static_cast<int>(std::lround(std::hypot(edge.x - center.center.x, edge.y - center.center.y))) };
+                if (r >= band.min_radius && r <= band.max_radius) {
+                    ++counts[r - band.min_radius];
+                }
+            }
+            int best{ -1 };
+            for (int i{ 0 }; i < static_cast<int>(counts.size()); ++i) {
+                if (best < 0 || counts[i] * static_cast<double>(best + band.min_radius) > counts[best] * static_cast<double>(i + band.min_radius)) {
+                    best = i;
+                }
+            }
+            if (counts[best] > votes_threshold) {
+                center.radius = static_cast<float>(best + band.min_radius);
+                accepted[c] = 1;
+            }
+            });
+
+        std::vector<HoughCircle> circles;
+        for (std::size_t c{ 0 }; c < centers.size(); ++c) {
+            if (accepted[c]) {
+                circles.push_back(centers[c]);
+            }
+        }
+        return circles;
+    }
+
+    /// <summary>
+    /// Coarse search on a downscaled image, every coarse circle becomes a small ROI with a narrow band at full size
+    /// </summary>
+    std::vector<Task> refinementTasks(const cv::Mat& gray, const std::vector<RadiusBand>& bands, const std::vector<cv::Rect>& regions, HoughCircleWork& work) const {
+        const double scale{ coarse_scale_ };
+        cv::Mat small;
+        cv::resize(gray, small, cv::Size(), scale, scale, cv::INTER_AREA);
+        const cv::Rect small_image(0, 0, small.cols, small.rows);
+
+        std::vector<Task> coarse;
+        for (const auto& region : regions) {
+            cv::Rect small_region(cv::Point(static_cast<int>(region.x * scale), static_cast<int>(region.y * scale)),
+                cv::Point(static_cast<int>(std::ceil((region.x + region.width) * scale)), static_cast<int>(std::ceil((region.y + region.height) * scale))));
+            small_region &= small_image;
+            if (small_region.empty()) {
+                continue;
+            }
+            for (const auto& band : bands) {
+                coarse.push_back({ small_region, { std::max(1, static_cast<int>(band.min_radius * scale)), std::max(1, static_cast<int>(std::ceil(band.max_radius * scale))) } });
+            }
+        }
+        auto candidates{ search(small, coarse, scale, work) };
+        // One coarse pixel is 1 / scale pixels, centres and radii are refined within twice that
+        const int tolerance{ static_cast<int>(std::ceil(2 / scale)) };
+        const cv::Rect image(0, 0, gray.cols, gray.rows);
+        std::vector<Task> tasks;
+        for (const auto& candidate : candidates) {
+            const cv::Point center(cvRound(candidate.center.x), cvRound(candidate.center.y));
+            const cv::Rect roi{ cv::Rect(center.x - tolerance, center.y - tolerance, 2 * tolerance + 1, 2 * tolerance + 1) & image };
+            const int radius{ cvRound(candidate.radius) };
+            for (const auto& band : bands) {
+                RadiusBand narrow{ std::max(band.min_radius, radius - tolerance), std::min(band.max_radius, radius + tolerance) };
+                if (!roi.empty() && narrow.min_radius <= narrow.max_radius) {
+                    tasks.push_back({ roi, narrow });
+                }
+            }
+        }
+        return tasks;
+    }
+
+    /// <summary>
+    /// Keeps the strongest circles which are at least min_dist apart
+    /// </summary>
+    static std::vector<HoughCircle> suppress(std::vector<HoughCircle> circles, double min_dist) {
+        std::ranges::stable_sort(circles, std::ranges::greater{}, &HoughCircle::votes);
+        std::vector<HoughCircle> kept;
+        const double min_dist2{ min_dist * min_dist };
+        for (const auto& circle : circles) {
+            bool far{ std::ranges::all_of(kept, [&](const HoughCircle& other) {
+                const double dx{ circle.center.x - other.center.x };
+                const double dy{ circle.center.y - other.center.y };
+                return dx * dx + dy * dy >= min_dist2;
+                }) };
+            if (far) {
+                kept.push_back(circle);
+            }
+        }
+        return kept;
+    }
+};
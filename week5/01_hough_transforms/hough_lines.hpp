@@ -0,0 +1,434 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <stdexcept>
+#include <format>
+#include <vector>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <array>
+#include <limits>
+#include <cmath>
+
+/// <summary>
+/// Line segment detector with the parameters of cv::HoughLinesP, organized in tiles of the image:
+///     1. every tile votes its edge points into its own accumulator, which covers only the rho range the tile can reach
+///        for every angle, sin and cos of all angles come from a table computed once
+///     2. tile accumulators are summed into the global accumulator row by row (angle) in parallel
+///     3. local maxima above the threshold are the lines, strongest first
+///     4. every tile walks the lines crossing it and extracts runs of edge pixels with gaps up to max_line_gap,
+///        pixels of a run are consumed so weaker lines can't reuse them, consumed pixels which voted for a weaker line
+///        are taken from its votes
+///     5. a line is kept only if its remaining votes from all tiles still reach the threshold, like the un-voting of
+///        cv::HoughLinesP, so near-duplicate peaks of one line don't become parallel segments. Its runs from all tiles
+///        are merged across tile borders with the same gap rule and filtered by length
+/// Temporal mode (track) votes only angles around lines of the previous frame and keeps only peaks close to them,
+/// a full detection runs every refresh frames or when no line is found.
+/// Unlike cv::HoughLinesP no random sampling is used, results are deterministic.
+/// </summary>
+class HoughLineDetector {
+public:
+    /// <param name="rho">Distance resolution of the accumulator in pixels</param>
+    /// <param name="theta">Angle resolution of the accumulator in radians</param>
+    /// <param name="threshold">Minimum number of votes of a line</param>
+    /// <param name="min_line_length">Segments shorter than this are rejected</param>
+    /// <param name="max_line_gap">Maximum gap between points of the same segment</param>
+    /// <param name="tile_size">Side of a square tile in pixels</param>
+    HoughLineDetector(double rho = 1, double theta = CV_PI / 180, int threshold = 100, double min_line_length = 0, double max_line_gap = 0, int tile_size = 256)
+        : rho_(rho), threshold_(threshold), min_line_length_(min_line_length), max_line_gap_(static_cast<int>(max_line_gap)), tile_size_(tile_size) {
+        if (rho <= 0 || theta <= 0 || threshold <= 0 || tile_size < 16) {
+            throw std::runtime_error(std::format("Wrong Hough line parameters: rho {}, theta {}, threshold {}, tile {}\n", rho, theta, threshold, tile_size));
+        }
+
+        // Angles [0, pi), values are divided by rho so a table entry gives the accumulator column directly
+        const int angles{ std::max(1, cvRound(CV_PI / theta)) };
+        cos_.resize(angles);
+        sin_.resize(angles);
+        for (int n{ 0 }; n < angles; ++n) {
+            cos_[n] = static_cast<float>(std::cos(n * theta) / rho);
+            sin_[n] = static_cast<float>(std::sin(n * theta) / rho);
+        }
+        theta_ = theta;
+    }
+
+    /// <summary>
+    /// Segments of a binary edge image (e.g. output of cv::Canny), the same format as cv::HoughLinesP
+    /// </summary>
+    std::vector<cv::Vec4i> detect(const cv::Mat& edges) {
+        std::vector<int> angles(cos_.size());
+        std::iota(angles.begin(), angles.end(), 0);
+        frames_since_refresh_ = 0;
+        return run(edges, angles, {}, 0, 0);
+    }
+
+    /// <summary>
+    /// Segments of the next frame of a video, only angles within theta_window bins and rho within rho_window bins
+    /// of lines of the previous frame are searched
+    /// </summary>
+    std::vector<cv::Vec4i> track(const cv::Mat& edges, int theta_window = 3, int rho_window = 8, int refresh = 30) {
+        if (previous_.empty() || ++frames_since_refresh_ >= refresh) {
+            return detect(edges);
+        }
+
+        const int angles{ static_cast<int>(cos_.size()) };
+        std::vector<char> selected(angles, 0);
+        for (const auto& peak : previous_) {
+            for (int d{ -theta_window }; d <= theta_window; ++d) {
+                // Angle wraps around, a line at pi - e is the line at -e with negative rho
+                selected[(peak.angle + d + angles) % angles] = 1;
+            }
+        }
+        std::vector<int> subset;
+        for (int n{ 0 }; n < angles; ++n) {
+            if (selected[n]) {
+                subset.push_back(n);
+            }
+        }
+
+        auto previous{ previous_ };
+        auto lines{ run(edges, subset, previous, theta_window, rho_window) };
+        if (lines.empty()) {
+            return detect(edges);
+        }
+        return lines;
+    }
+
+    /// <summary>
+    /// Number of angles voted in the last call, all of them for detect
+    /// </summary>
+    int getVotedAngles() const {
+        return voted_angles_;
+    }
+
+private:
+    struct Peak {
+        int angle;
+        int rho;
+        int votes;
+    };
+
+    struct Tile {
+        cv::Rect rect;
+        std::vector<cv::Point> points;
+        // Column of the global accumulator where every angle row of this tile starts
+        std::vector<int> offsets;
+        int width{ 0 };
+        std::vector<int> accumulator;
+    };
+
+    /// <summary>
+    /// Run of edge pixels of a line, positions along the major axis of the line
+    /// </summary>
+    struct LineRun {
+        int line;
+        int start;
+        int end;
+    };
+
+    double rho_;
+    double theta_{ 0 };
+    int threshold_;
+    double min_line_length_;
+    int max_line_gap_;
+    int tile_size_;
+    std::vector<float> cos_;
+    std::vector<float> sin_;
+
+    std::vector<Peak> previous_;
+    int frames_since_refresh_{ 0 };
+    int voted_angles_{ 0 };
+
+    std::vector<cv::Vec4i> run(const cv::Mat& edges, const std::vector<int>& angles, const std::vector<Peak>& seeds, int theta_window, int rho_window) {
+        if (edges.empty() || edges.type() != CV_8U) {
+            throw std::runtime_error("Hough line detector works only with single channel 8-bit images!\n");
+        }
+        voted_angles_ = static_cast<int>(angles.size());
+        const int rhos{ cvRound(((edges.cols + edges.rows) * 2 + 1) / rho_) };
+
+        // 1. Edge points and votes of every tile
+        std::vector<Tile> tiles;
+        for (int y{ 0 }; y < edges.rows; y += tile_size_) {
+            for (int x{ 0 }; x < edges.cols; x += tile_size_) {
+                tiles.push_back({ cv::Rect(x, y, std::min(tile_size_, edges.cols - x), std::min(tile_size_, edges.rows - y)) });
+            }
+        }
+        std::for_each(std::execution::par, tiles.begin(), tiles.end(), [&](Tile& tile) {
+            vote(edges, tile, angles, rhos);
+            });
+
+        // 2. Global accumulator, rows of different angles are independent
+        std::vector<int> accumulator(cos_.size() * rhos, 0);
+        std::vector<int> rows(angles.size());
+        std::iota(rows.begin(), rows.end(), 0);
+        std::for_each(std::execution::par, rows.begin(), rows.end(), [&](int a) {
+            int* global{ accumulator.data() + static_cast<std::size_t>(angles[a]) * rhos };
+            for (const auto& tile : tiles) {
+                if (tile.points.empty()) {
+                    continue;
+                }
+                const int* local{ tile.accumulator.data() + static_cast<std::size_t>(a) * tile.width };
+                int* dst{ global + tile.offsets[a] };
+                for (int r{ 0 }; r < tile.width; ++r) {
+                    dst[r] += local[r];
+                }
+            }
+            });
+
+        // 3. Lines
+        auto peaks{ findPeaks(accumulator, angles, rhos, seeds, theta_window, rho_window) };
+
+        // 4. Runs of every line inside every tile and votes taken by stronger lines
+        std::vector<std::vector<LineRun>> tile_runs(tiles.size());
+        std::vector<std::vector<int>> tile_removed(tiles.size(), std::vector<int>(peaks.size(), 0));
+        std::vector<int> indices(tiles.size());
+        std::iota(indices.begin(), indices.end(), 0);
+        std::for_each(std::execution::par, indices.begin(), indices.end(), [&](int t) {
+            tile_runs[t] = extractRuns(edges, tiles[t], peaks, rhos, tile_removed[t]);
+            });
+
+        // 5. Runs of a line from neighbouring tiles are joined
+        std::vector<std::vector<LineRun>> line_runs(peaks.size());
+        std::vector<int> removed(peaks.size(), 0);
+        for (std::size_t t{ 0 }; t < tiles.size(); ++t) {
+            for (const auto& run : tile_runs[t]) {
+                line_runs[run.line].push_back(run);
+            }
+            for (std::size_t l{ 0 }; l < peaks.size(); ++l) {
+                removed[l] += tile_removed[t][l];
+            }
+        }
+
+        std::vector<cv::Vec4i> lines;
+        std::vector<Peak> found;
+        for (std::size_t l{ 0 }; l < peaks.size(); ++l) {
+            if (peaks[l].votes - removed[l] < threshold_) {
+                continue;
+            }
+            auto& runs{ line_runs[l] };
+            std::ranges::sort(runs, {}, &LineRun::start);
+            bool line_found{ false };
+            for (std::size_t i{ 0 }; i < runs.size();) {
+                LineRun segment{ runs[i] };
+                std::size_t j{ i + 1 };
+                while (j < runs.size() && runs[j].start - segment.end <= max_line_gap_ + 1) {
+                    segment.end = std::max(segment.end, runs[j].end);
+                    ++j;
+                }
+                i = j;
+                // Length along the major axis, the same rule as cv::HoughLinesP
+                if (segment.end - segment.start >= min_line_length_) {
+                    lines.push_back(endpoints(peaks[l], segment, rhos));
+                    line_found = true;
+                }
+            }
+            if (line_found) {
+                found.push_back(peaks[l]);
+            }
+        }
+        previous_ = std::move(found);
+        return lines;
+    }
+
+    /// <summary>
+    /// Votes of points of a tile, the accumulator has one row per voted angle and only columns the tile can reach
+    /// </summary>
+    void vote(const cv::Mat& edges, Tile& tile, const std::vector<int>& angles, int rhos) const {
+        const auto& rect{ tile.rect };
+        for (int y{ rect.y }; y < rect.y + rect.height; ++y) {
+            const uchar* row{ edges.ptr<uchar>(y) };
+            for (int x{ rect.x }; x < rect.x + rect.width; ++x) {
+                if (row[x]) {
+                    tile.points.emplace_back(x, y);
+                }
+            }
+        }
+        if (tile.points.empty()) {
+            return;
+        }
+
+        // Rounding is monotonic, so columns of all points lie between columns of the corners
+        const int center{ (rhos - 1) / 2 };
+        const std::array<cv::Point, 4> corners{ { rect.tl(), { rect.x + rect.width - 1, rect.y }, { rect.x, rect.y + rect.height - 1 }, rect.br() - cv::Point(1, 1) } };
+        tile.offsets.resize(angles.size());
+        std::vector<int> lows(angles.size());
+        for (std::size_t a{ 0 }; a < angles.size(); ++a) {
+            int low{ std::numeric_limits<int>::max() };
+            int high{ std::numeric_limits<int>::min() };
+            for (const auto& corner : corners) {
+                const int r{ cvRound(corner.x * cos_[angles[a]] + corner.y * sin_[angles[a]]) };
+                low = std::min(low, r);
+                high = std::max(high, r);
+            }
+            lows[a] = low;
+            tile.offsets[a] = low + center;
+            tile.width = std::max(tile.width, high - low + 1);
+        }
+
+        tile.accumulator.assign(angles.size() * tile.width, 0);
+        for (const auto& point : tile.points) {
+            for (std::size_t a{ 0 }; a < angles.size(); ++a) {
+                const int r{ cvRound(point.x * cos_[angles[a]] + point.y * sin_[angles[a]]) };
+                ++tile.accumulator[a * tile.width + (r - lows[a])];
+            }
+        }
+    }
+
+    /// <summary>
+    /// Local maxima of voted rows above the threshold, with seeds only maxima near a seed are kept
+    /// </summary>
+    std::vector<Peak> findPeaks(const std::vector<int>& accumulator, const std::vector<int>& angles, int rhos, const std::vector<Peak>& seeds, int theta_window, int rho_window) const {
+        const int total_angles{ static_cast<int>(cos_.size()) };
+        auto at = [&](int angle, int r) {
+            if (angle < 0 || angle >= total_angles || r < 0 || r >= rhos) {
+                return 0;
+            }
+            return accumulator[static_cast<std::size_t>(angle) * rhos + r];
+        };
+
+        std::vector<Peak> peaks;
+        for (int angle : angles) {
+            for (int r{ 0 }; r < rhos; ++r) {
+                const int votes{ at(angle, r) };
+                if (votes < threshold_ || votes <= at(angle, r - 1) || votes < at(angle, r + 1) || votes <= at(angle - 1, r) || votes < at(angle + 1, r)) {
+                    continue;
+                }
+                if (!seeds.empty()) {
+                    const int center{ (rhos - 1) / 2 };
+                    const bool near{ std::ranges::any_of(seeds, [&](const Peak& seed) {
+                        const bool wraps{ std::abs(seed.angle - angle) > total_angles / 2 };
+                        const int d_angle{ wraps ? total_angles - std::abs(seed.angle - angle) : std::abs(seed.angle - angle) };
+                        // Across the wrap the same line has the opposite rho
+                        const int seed_rho{ wraps ? 2 * center - seed.rho : seed.rho };
+                        return d_angle <= theta_window && std::abs(seed_rho - r) <= rho_window;
+                        }) };
+                    if (!near) {
+                        continue;
+                    }
+                }
+                peaks.push_back({ angle, r, votes });
+            }
+        }
+        std::ranges::stable_sort(peaks, std::ranges::greater{}, &Peak::votes);
+        return peaks;
+    }
+
+    /// <summary>
+    /// Parameters of the line of a peak: major axis and position on the minor axis for a position on the major axis
+    /// </summary>
+    struct LineGeometry {
+        bool major_x;
+        double c;
+        double s;
+        double rho;
+
+        double minor(int major) const {
+            return major_x ? (rho - major * c) / s : (rho - major * s) / c;
+        }
+    };
+
+    LineGeometry geometry(const Peak& peak, int rhos) const {
+        const double angle{ peak.angle * theta_ };
+        const double c{ std::cos(angle) };
+        const double s{ std::sin(angle) };
+        const double rho{ (peak.rho - (rhos - 1) / 2) * rho_ };
+        // Normal closer to the y axis means the line is closer to the x axis
+        return { std::abs(s) > std::abs(c), c, s, rho };
+    }
+
+    cv::Vec4i endpoints(const Peak& peak, const LineRun& run, int rhos) const {
+        const auto line{ geometry(peak, rhos) };
+        const int a{ cvRound(line.minor(run.start)) };
+        const int b{ cvRound(line.minor(run.end)) };
+        return line.major_x ? cv::Vec4i(run.start, a, run.end, b) : cv::Vec4i(a, run.start, b, run.end);
+    }
+
+    /// <summary>
+    /// Walks every line across a tile, strongest first. Runs long enough to be a segment or reaching the tile border
+    /// (a piece of a longer segment) consume their pixels. Removed receives for every line the number of its votes
+    /// which came from pixels consumed by stronger lines in this tile. A line which already lost too many votes here
+    /// isn't walked, so its leftovers don't consume pixels of weaker lines; a line dropped only after votes of all
+    /// tiles are summed keeps its consumed pixels.
+    /// </summary>
+    std::vector<LineRun> extractRuns(const cv::Mat& edges, const Tile& tile, const std::vector<Peak>& peaks, int rhos, std::vector<int>& removed) const {
+        std::vector<LineRun> runs;
+        if (tile.points.empty()) {
+            return runs;
+        }
+        const auto& rect{ tile.rect };
+        const int center{ (rhos - 1) / 2 };
+        cv::Mat consumed{ cv::Mat::zeros(rect.size(), CV_8U) };
+        // Consumed pixels in the order of consumption, the same accumulator cell as the votes of a peak
+        std::vector<cv::Point> taken;
+
+        std::vector<cv::Point> pixels;
+        for (int l{ 0 }; l < static_cast<int>(peaks.size()); ++l) {
+            const auto& peak{ peaks[l] };
+            for (const auto& pixel : taken) {
+                removed[l] += cvRound(pixel.x * cos_[peak.angle] + pixel.y * sin_[peak.angle]) + center == peak.rho;
+            }
+            if (peak.votes - removed[l] < threshold_) {
+                continue;
+            }
+
+            const auto line{ geometry(peak, rhos) };
+            const int major_begin{ line.major_x ? rect.x : rect.y };
+            const int major_end{ line.major_x ? rect.x + rect.width : rect.y + rect.height };
+            const int minor_begin{ line.major_x ? rect.y : rect.x };
+            const int minor_end{ line.major_x ? rect.y + rect.height : rect.x + rect.width };
+
+            int first{ -1 }, last{ -1 };
+            int start{ -1 }, end{ -1 };
+            pixels.clear();
+            auto close = [&]() {
+                if (start < 0) {
+                    return;
+                }
+                const bool touches_border{ start - first <= max_line_gap_ + 1 || last - end <= max_line_gap_ + 1 };
+                if (end - start >= min_line_length_ || touches_border) {
+                    runs.push_back({ l, start, end });
+                    for (const auto& pixel : pixels) {
+                        consumed.at<uchar>(pixel.y - rect.y, pixel.x - rect.x) = 1;
+                    }
+                    taken.insert(taken.end(), pixels.begin(), pixels.end());
+                }
+                pixels.clear();
+                start = -1;
+            };
+
+            // Positions of the line inside the tile form one interval of the major axis
+            for (int m{ major_begin }; m < major_end; ++m) {
+                const int n{ cvRound(line.minor(m)) };
+                if (n < minor_begin || n >= minor_end) {
+                    continue;
+                }
+                if (first < 0) {
+                    first = m;
+                }
+                last = m;
+            }
+            if (first < 0) {
+                continue;
+            }
+
+            for (int m{ first }; m <= last; ++m) {
+                const int n{ cvRound(line.minor(m)) };
+                const cv::Point pixel{ line.major_x ? cv::Point(m, n) : cv::Point(n, m) };
+                if (!edges.at<uchar>(pixel) || consumed.at<uchar>(pixel.y - rect.y, pixel.x - rect.x)) {
+                    continue;
+                }
+                if (start >= 0 && m - end > max_line_gap_ + 1) {
+                    close();
+                }
+                if (start < 0) {
+                    start = m;
+                }
+                end = m;
+                pixels.push_back(pixel);
+            }
+            close();
+        }
+        return runs;
+    }
+};
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <iostream>
+#include <opencv2/core.hpp>
+#include <opencv2/opencv.hpp>
+#include <opencv2/photo.hpp>
+#include <stdexcept>
+#include <format>
+#include <vector>
+#include <filesystem>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <cmath>
+#include <limits>
+#include <array>
+#include "tonemapping.hpp"
+
+/// <summary>
+/// Camera Response Function (CRF) calibrated once with Debevec method and cached on disk per camera.
+/// </summary>
+class CameraResponse {
+public:
+    /// <summary>
+    /// Loads CRF for given camera from the cache directory, calibrates and saves it if it isn't there yet
+    /// </summary>
+    /// <param name="cache_dir">Directory with cached responses</param>
+    /// <param name="camera_id">Name of the camera, used as a file name</param>
+    /// <param name="images">Aligned 8-bit exposures, used only when calibration is needed</param>
+    /// <param name="times">Exposure times in seconds</param>
+    /// <param name="calibration_width">Exposures are downscaled to this width before calibration, Debevec samples only a few pixels anyway</param>
+    /// <returns>CRF as 256x1 CV_32FC3 matrix</returns>
+    static cv::Mat loadOrCalibrate(const std::filesystem::path& cache_dir, const std::string& camera_id,
+        const std::vector<cv::Mat>& images, const std::vector<float>& times, int calibration_width = 640) {
+        auto path{ cachePath(cache_dir, camera_id) };
+
+        if (auto cached{ load(path) }; !cached.empty()) {
+            return cached;
+        }
+
+        auto response{ calibrate(images, times, calibration_width) };
+        save(path, camera_id, response);
+        return response;
+    }
+
+    static cv::Mat calibrate(const std::vector<cv::Mat>& images, const std::vector<float>& times, int calibration_width = 640) {
+        if (images.empty() || images.size() != times.size()) {
+            throw std::runtime_error("Calibration needs the same, non-zero number of images and exposure times!\n");
+        }
+
+        std::vector<cv::Mat> small;
+        small.reserve(images.size());
+        for (const auto& image : images) {
+            if (image.cols > calibration_width) {
+                double scale{ static_cast<double>(calibration_width) / image.cols };
+                cv::Mat resized;
+                cv::resize(image, resized, {}, scale, scale, cv::INTER_AREA);
+                small.emplace_back(std::move(resized));
+            }
+            else {
+                small.emplace_back(image);
+            }
+        }
+
+        cv::Mat response;
+        cv::Ptr<cv::CalibrateDebevec> calibrate_debevec{ cv::createCalibrateDebevec() };
+        calibrate_debevec->process(small, response, times);
+        return response;
+    }
+
+    static std::filesystem::path cachePath(const std::filesystem::path& cache_dir, const std::string& camera_id) {
+        return cache_dir / std::format("crf_{}.yml", camera_id);
+    }
+
+private:
+    static cv::Mat load(const std::filesystem::path& path) {
+        if (!std::filesystem::exists(path)) {
+            return {};
+        }
+        cv::FileStorage fs(path.string(), cv::FileStorage::READ);
+        cv::Mat response;
+        fs["response"] >> response;
+        if (response.rows != 256 || response.type() != CV_32FC3) {
+            std::cerr << std::format("Ignoring invalid cached response: {}\n", path.string());
+            return {};
+        }
+        return response;
+    }
+
+    static void save(const std::filesystem::path& path, const std::string& camera_id, const cv::Mat& response) {
+        if (path.has_parent_path()) {
+            std::filesystem::create_directories(path.parent_path());
+        }
+        cv::FileStorage fs(path.string(), cv::FileStorage::WRITE);
+        if (!fs.isOpened()) {
+            std::cerr << std::format("Can't cache response in: {}\n", path.string());
+            return;
+        }
+        fs << "camera" << camera_id;
+        fs << "response" << response;
+    }
+};
+
+/// <summary>
+/// Debevec merge of 8-bit exposures done band by band, so float intermediates are bounded by band size
+/// instead of number of images times resolution. Bands are processed in parallel.
+/// </summary>
+class HdrEngine {
+public:
+    HdrEngine(const cv::Mat& response, int band_rows = 64) : band_rows_(std::max(band_rows, 1)) {
+        if (response.rows != 256 || response.type() != CV_32FC3) {
+            throw std::runtime_error("Camera response must be 256x1 CV_32FC3 matrix!\n");
+        }
+
+        // Log of response and triangle weights, the same as in cv::MergeDebevec
+        for (int z{ 0 }; z < 256; ++z) {
+            const auto& value{ response.at<cv::Vec3f>(z) };
+            for (int c{ 0 }; c < 3; ++c) {
+                log_response_[z][c] = std::log(std::max(value[c], LuminanceStats::epsilon));
+            }
+            weights_[z] = z < 128 ? z + 1.0f : 256.0f - z;
+        }
+    }
+
+    int getBandRows() const {
+        return band_rows_;
+    }
+
+    /// <summary>
+    /// Merges exposures into radiance for rows of the image
+    /// </summary>
+    /// <param name="images">Aligned 8-bit, 3-channel exposures with the same size</param>
+    /// <param name="times">Exposure times in seconds</param>
+    /// <param name="rows">Rows of the image to merge</param>
+    /// <param name="band">Output CV_32FC3 radiance with rows.size() rows, reallocated only if needed</param>
+    void mergeBand(const std::vector<cv::Mat>& images, const std::vector<float>& times, cv::Range rows, cv::Mat& band) const {
+        const auto n_images{ images.size() };
+        std::vector<float> log_times(n_images);
+        std::ranges::transform(times, log_times.begin(), [](float t) { return std::log(t); });
+
+        band.create(rows.size(), images.front().cols, CV_32FC3);
+        std::vector<const cv::Vec3b*> src(n_images);
+
+        for (int y{ rows.start }; y < rows.end; ++y) {
+            for (std::size_t i{ 0 }; i < n_images; ++i) {
+                src[i] = images[i].ptr<cv::Vec3b>(y);
+            }
+            auto* dst{ band.ptr<cv::Vec3f>(y - rows.start) };
+
+            for (int x{ 0 }; x < band.cols; ++x) {
+                cv::Vec3f sum{ 0, 0, 0 };
+                float weight_sum{ 0 };
+                for (std::size_t i{ 0 }; i < n_images; ++i) {
+                    const auto& pixel{ src[i][x] };
+                    float w{ (weights_[pixel[0]] + weights_[pixel[1]] + weights_[pixel[2]]) / 3.0f };
+                    for (int c{ 0 }; c < 3; ++c) {
+                        sum[c] += w * (log_response_[pixel[c]][c] - log_times[i]);
+                    }
+                    weight_sum += w;
+                }
+                for (int c{ 0 }; c < 3; ++c) {
+                    dst[x][c] = std::exp(sum[c] / weight_sum);
+                }
+            }
+        }
+    }
+
+    /// <summary>
+    /// First pass - luminance statistics of the whole radiance map, without storing it
+    /// </summary>
+    LuminanceStats computeStats(const std::vector<cv::Mat>& images, const std::vector<float>& times) const {
+        checkInputs(images, times);
+        auto bands{ makeBands(images.front().rows, band_rows_) };
+        std::vector<LuminanceStats> band_stats(bands.size());
+
+        std::vector<std::size_t> indices(bands.size());
+        std::iota(indices.begin(), indices.end(), 0);
+        std::for_each(std::execution::par, indices.begin(), indices.end(), [&](std::size_t idx) {
+            thread_local cv::Mat radiance;
+            mergeBand(images, times, bands[idx], radiance);
+            accumulateStats(radiance, band_stats[idx]);
+            });
+
+        LuminanceStats stats;
+        for (const auto& band : band_stats) {
+            stats.merge(band);
+        }
+        return stats;
+    }
+
+    /// <summary>
+    /// Second pass - merges every band again and tone maps it straight into 8-bit output.
+    /// Recomputing the merge is cheaper than keeping the whole float radiance map in memory.
+    /// </summary>
+    cv::Mat process(const std::vector<cv::Mat>& images, const std::vector<float>& times,
+        const TonemapParams& tonemap = {}) const {
+        auto stats{ computeStats(images, times) };
+
+        cv::Mat output(images.front().size(), CV_8UC3);
+        auto bands{ makeBands(images.front().rows, band_rows_) };
+        std::for_each(std::execution::par, bands.begin(), bands.end(), [&](const cv::Range& rows) {
+            thread_local cv::Mat radiance;
+            mergeBand(images, times, rows, radiance);
+            cv::Mat output_band{ output.rowRange(rows) };
+            tonemapBand(tonemap, radiance, cv::Mat{}, output_band, stats);
+            });
+
+        return output;
+    }
+
+    /// <summary>
+    /// Single pass version for video - tone maps with statistics of a previous radiance map
+    /// and collects statistics of the current one for the next call
+    /// </summary>
+    /// <param name="images">Aligned 8-bit, 3-channel exposures with the same size</param>
+    /// <param name="times">Exposure times in seconds</param>
+    /// <param name="tonemap">Tone mapping operator</param>
+    /// <param name="previous">Statistics used for tone mapping</param>
+    /// <param name="current">Statistics of the merged radiance map</param>
+    /// <param name="output">8-bit output, reallocated only if needed</param>
+    void processSinglePass(const std::vector<cv::Mat>& images, const std::vector<float>& times,
+        const TonemapParams& tonemap, const LuminanceStats& previous, LuminanceStats& current, cv::Mat& output) const {
+        checkInputs(images, times);
+        output.create(images.front().size(), CV_8UC3);
+
+        auto bands{ makeBands(images.front().rows, band_rows_) };
+        std::vector<LuminanceStats> band_stats(bands.size());
+        std::vector<std::size_t> indices(bands.size());
+        std::iota(indices.begin(), indices.end(), 0);
+        std::for_each(std::execution::par, indices.begin(), indices.end(), [&](std::size_t idx) {
+            thread_local cv::Mat radiance;
+            mergeBand(images, times, bands[idx], radiance);
+            accumulateStats(radiance, band_stats[idx]);
+            cv::Mat output_band{ output.rowRange(bands[idx]) };
+            tonemapBand(tonemap, radiance, cv::Mat{}, output_band, previous);
+            });
+
+        current = {};
+        for (const auto& band : band_stats) {
+            current.merge(band);
+        }
+    }
+
+    /// <summary>
+    /// Full radiance map, stored as CV_16FC3 (half of float memory) or CV_32FC3
+    /// </summary>
+    cv::Mat mergeRadiance(const std::vector<cv::Mat>& images, const std::vector<float>& times, int depth = CV_16F) const {
+        checkInputs(images, times);
+        if (depth != CV_16F && depth != CV_32F) {
+            throw std::runtime_error("Radiance can be stored only as CV_16F or CV_32F!\n");
+        }
+
+        cv::Mat radiance(images.front().size(), CV_MAKETYPE(depth, 3));
+        auto bands{ makeBands(images.front().rows, band_rows_) };
+        std::for_each(std::execution::par, bands.begin(), bands.end(), [&](const cv::Range& rows) {
+            thread_local cv::Mat band;
+            mergeBand(images, times, rows, band);
+            cv::Mat radiance_band{ radiance.rowRange(rows) };
+            band.convertTo(radiance_band, depth);
+            });
+
+        return radiance;
+    }
+
+    /// <summary>
+    /// Number of bytes of float buffers alive at the same time for given number of threads
+    /// </summary>
+    std::size_t peakBandBytes(int width, int threads) const {
+        return static_cast<std::size_t>(band_rows_) * width * sizeof(cv::Vec3f) * std::max(threads, 1);
+    }
+
+private:
+    int band_rows_;
+    std::array<cv::Vec3f, 256> log_response_{};
+    std::array<float, 256> weights_{};
+
+    static void accumulateStats(const cv::Mat& radiance, LuminanceStats& stats) {
+        for (int y{ 0 }; y < radiance.rows; ++y) {
+            const auto* row{ radiance.ptr<cv::Vec3f>(y) };
+            for (int x{ 0 }; x < radiance.cols; ++x) {
+                stats.add(luminanceOf(row[x]));
+            }
+        }
+    }
+
+    static void checkInputs(const std::vector<cv::Mat>& images, const std::vector<float>& times) {
+        if (images.empty() || images.size() != times.size()) {
+            throw std::runtime_error("Merge needs the same, non-zero number of images and exposure times!\n");
+        }
+        for (const auto& image : images) {
+            if (image.type() != CV_8UC3 || image.size() != images.front().size()) {
+                throw std::runtime_error("All exposures must be 8-bit, 3-channel images with the same size!\n");
+            }
+        }
+    }
+};
@@ -0,0 +1,251 @@
+#include <iostream>
+#include <opencv2/core.hpp>
+#include <opencv2/opencv.hpp>
+#include <opencv2/highgui.hpp>
+#include <opencv2/photo.hpp>
+#include <stdexcept>
+#include <format>
+#include <print>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <optional>
+#include <filesystem>
+#include <expected>
+#include <exception>
+#include "hdr_engine.hpp"
+
+/// <summary>
+/// Queue with limited capacity, push blocks when it is full, pop blocks when it is empty until it is closed
+/// </summary>
+template <typename T>
+class BoundedQueue {
+public:
+    BoundedQueue(std::size_t capacity) : capacity_(std::max<std::size_t>(capacity, 1)) {}
+
+    bool push(T value) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this] { return closed_ || queue_.size() < capacity_; });
+        if (closed_) {
+            return false;
+        }
+        queue_.push_back(std::move(value));
+        not_empty_.notify_one();
+        return true;
+    }
+
+    std::optional<T> pop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] { return closed_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            return std::nullopt;
+        }
+        T value{ std::move(queue_.front()) };
+        queue_.pop_front();
+        not_full_.notify_one();
+        return value;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+
+private:
+    std::size_t capacity_;
+    std::deque<T> queue_;
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    bool closed_{ false };
+};
+
+/// <summary>
+/// Keeps the latest frame of every exposure of a bracket, aligned to the latest frame of the reference exposure.
+/// The reference frame is never shifted, so errors don't accumulate over frames and the output follows the camera.
+/// A new frame is aligned once against the current reference, a new reference frame realigns the other slots.
+/// </summary>
+class BracketAligner {
+public:
+    BracketAligner(std::size_t bracket_size, std::size_t reference_slot, int max_bits = 4)
+        : slots_(bracket_size), frames_(bracket_size), grays_(bracket_size), reference_slot_(reference_slot), align_mtb_(cv::createAlignMTB(max_bits)) {
+        if (reference_slot_ >= bracket_size) {
+            throw std::runtime_error("Reference slot must be inside the bracket!\n");
+        }
+    }
+
+    /// <summary>
+    /// Aligns a frame and stores it in its exposure slot. Slots get new buffers, so bracket snapshots
+    /// returned earlier stay valid without copying
+    /// </summary>
+    void add(const cv::Mat& frame, std::size_t slot) {
+        frames_.at(slot) = frame.clone();
+        cv::cvtColor(frame, grays_[slot], cv::COLOR_BGR2GRAY);
+
+        if (slot == reference_slot_) {
+            slots_[slot] = frames_[slot];
+            for (std::size_t other{ 0 }; other < slots_.size(); ++other) {
+                if (other != reference_slot_ && !frames_[other].empty()) {
+                    align(other);
+                }
+            }
+        }
+        else if (!frames_[reference_slot_].empty()) {
+            align(slot);
+        }
+        else {
+            // Aligned when the first reference frame comes
+            slots_[slot] = frames_[slot];
+        }
+    }
+
+    bool isComplete() const {
+        return std::ranges::none_of(slots_, [](const cv::Mat& slot) { return slot.empty(); });
+    }
+
+    std::vector<cv::Mat> snapshot() const {
+        return slots_;
+    }
+
+private:
+    // Aligned frames
+    std::vector<cv::Mat> slots_;
+    // Latest frames as they came and their gray versions
+    std::vector<cv::Mat> frames_;
+    std::vector<cv::Mat> grays_;
+    std::size_t reference_slot_;
+    cv::Ptr<cv::AlignMTB> align_mtb_;
+
+    void align(std::size_t slot) {
+        // Only motion within a bracket, a few pyramid levels are enough
+        cv::Point shift{ align_mtb_->calculateShift(grays_[reference_slot_], grays_[slot]) };
+        cv::Mat aligned;
+        align_mtb_->shiftMat(frames_[slot], aligned, shift);
+        slots_[slot] = std::move(aligned);
+    }
+};
+
+int main(int argc, char** argv) {
+    // Frames of the video cycle through exposures with these times
+    std::filesystem::path path{ argc > 1 ? argv[1] : "../data/videos/hdr_bracketed.mp4" };
+    const std::vector<float> times{ 1 / 30.0f, 0.25f, 2.5f, 15.0f };
+    const std::size_t reference_slot{ times.size() / 2 };
+
+    cv::VideoCapture cap{ path.string() };
+    if (!cap.isOpened()) {
+        std::cerr << std::format("Can't load video from: {}\n", path.string());
+        return EXIT_FAILURE;
+    }
+
+    int width{ static_cast<int>(cap.get(cv::CAP_PROP_FRAME_WIDTH)) };
+    int height{ static_cast<int>(cap.get(cv::CAP_PROP_FRAME_HEIGHT)) };
+    double fps{ cap.get(cv::CAP_PROP_FPS) };
+    const std::string output_path{ "hdr-output.mp4" };
+    cv::VideoWriter out(output_path, cv::VideoWriter::fourcc('M', 'P', '4', 'V'), fps > 0 ? fps : 30, cv::Size(width, height));
+    if (!out.isOpened()) {
+        std::cerr << std::format("Can't open video writer for: {}\n", output_path);
+        return EXIT_FAILURE;
+    }
+
+    BracketAligner aligner{ times.size(), reference_slot };
+    BoundedQueue<std::vector<cv::Mat>> brackets{ 2 };
+    // Frames or the error which stopped the merge
+    BoundedQueue<std::expected<cv::Mat, std::exception_ptr>> tonemapped{ 2 };
+
+    // Collect the first bracket, calibrate CRF once (or load it from cache) and reuse it for every frame
+    cv::Mat frame;
+    std::size_t frame_idx{ 0 };
+    while (!aligner.isComplete() && cap.read(frame)) {
+        aligner.add(frame, frame_idx++ % times.size());
+    }
+    if (!aligner.isComplete()) {
+        std::cerr << "Video is shorter than a single bracket!\n";
+        return EXIT_FAILURE;
+    }
+
+    // The response is cached per video, frames of a single video come from a single camera
+    cv::Mat response;
+    try {
+        response = CameraResponse::loadOrCalibrate("../data/crf", path.stem().string(), aligner.snapshot(), times);
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+    HdrEngine engine{ response, 32 };
+    TonemapParams tonemap;
+    tonemap.gain = 3.0f;
+
+    // Merge and tone map on its own thread, statistics of a frame are used to tone map the next one.
+    // An error is passed to the writer and stops reading of new brackets
+    std::thread merge_thread{ [&] {
+        try {
+            LuminanceStats previous{ engine.computeStats(aligner.snapshot(), times) };
+            LuminanceStats current;
+            while (auto bracket{ brackets.pop() }) {
+                cv::Mat ldr;
+                engine.processSinglePass(*bracket, times, tonemap, previous, current, ldr);
+                previous = current;
+                if (!tonemapped.push(std::move(ldr))) {
+                    break;
+                }
+            }
+        }
+        catch (...) {
+            brackets.close();
+            tonemapped.push(std::unexpected(std::current_exception()));
+        }
+        tonemapped.close();
+        } };
+
+    // Encoding on its own thread
+    std::size_t written{ 0 };
+    std::exception_ptr error;
+    std::thread write_thread{ [&] {
+        while (auto ldr{ tonemapped.pop() }) {
+            if (!ldr->has_value()) {
+                error = ldr->error();
+                break;
+            }
+            out.write(**ldr);
+            ++written;
+        }
+        } };
+
+    // Sliding bracket - every new frame replaces its exposure and produces one HDR frame
+    auto start{ std::chrono::steady_clock::now() };
+    brackets.push(aligner.snapshot());
+    while (cap.read(frame)) {
+        aligner.add(frame, frame_idx++ % times.size());
+        if (!brackets.push(aligner.snapshot())) {
+            break;
+        }
+    }
+    brackets.close();
+
+    merge_thread.join();
+    write_thread.join();
+    std::chrono::duration<double> elapsed{ std::chrono::steady_clock::now() - start };
+
+    if (error) {
+        try {
+            std::rethrow_exception(error);
+        }
+        catch (std::exception& e) {
+            std::cerr << std::format("HDR merge stopped after {} frames: {}\n", written, e.what());
+        }
+        return EXIT_FAILURE;
+    }
+
+    std::println("{} HDR frames {}x{} in {:.2f} s: {:.2f} fps",
+        written, width, height, elapsed.count(), elapsed.count() > 0 ? written / elapsed.count() : 0.0);
+
+    cap.release();
+    out.release();
+    return 0;
+}
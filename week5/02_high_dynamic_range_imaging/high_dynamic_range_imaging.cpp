@@ -8,6 +8,8 @@
 #include <numbers>
 #include <ranges>
 #include <array>
+#include <future>
+#include "tonemapping.hpp"
 
 int main() {
 
@@ -55,33 +57,25 @@ int main() {
     merge_robertson->process(images, hdr_robertson, times, response_robertson);
 
     // 5. Tone mapping - three methods
-    // Drago
-    cv::Mat drago_debevec, drago_robertson;
-    cv::Ptr<cv::TonemapDrago> tonemap_drago{ cv::createTonemapDrago(1.0, 0.7) };
-    
-    tonemap_drago->process(hdr_debevec, drago_debevec);
-    drago_debevec = 3 * drago_debevec;
-
-    tonemap_drago->process(hdr_robertson, drago_robertson);
-    drago_robertson = 3 * drago_robertson;
-
-    // Reinhard
-    cv::Mat reinhard_debevec, reinhard_robertson;
-    cv::Ptr<cv::TonemapReinhard> tonemap_reinhard{ cv::createTonemapReinhard(1.5, 0, 0, 0) };
-
-    tonemap_reinhard->process(hdr_debevec, reinhard_debevec);
-
-    tonemap_reinhard->process(hdr_robertson, reinhard_robertson);
-
-    // Mantiuk
-    cv::Mat mantiuk_debevec, mantiuk_robertson;
-    cv::Ptr<cv::TonemapMantiuk> tonemap_mantiuk{ cv::createTonemapMantiuk(2.2, 0.85, 1.2) };
-
-    tonemap_mantiuk->process(hdr_debevec, mantiuk_debevec);
-    mantiuk_debevec = 3 * mantiuk_debevec;
-
-    tonemap_mantiuk->process(hdr_robertson, mantiuk_robertson);
-    mantiuk_robertson = 3 * mantiuk_robertson;
+    // Luminance and its statistics are computed once per radiance map and shared by all operators,
+    // operators run concurrently and apply gain with 8-bit conversion in their output pass.
+    // Drago and Reinhard are the published global operators, not cv::TonemapDrago and cv::TonemapReinhard,
+    // see TonemapType
+    const std::vector<TonemapParams> operators{
+        { .type = TonemapType::DragoLogarithmic, .name = "Drago logarithmic", .gamma = 1.0f, .saturation = 0.7f, .gain = 3.0f },
+        { .type = TonemapType::ReinhardPhotographic, .name = "Reinhard photographic", .gamma = 1.5f },
+        { .type = TonemapType::Mantiuk, .name = "Mantiuk", .gamma = 2.2f, .saturation = 1.2f, .gain = 3.0f, .scale = 0.85f }
+    };
+
+    auto tonemap = [&operators](const cv::Mat& hdr) {
+        SharedTonemapper tonemapper;
+        tonemapper.setRadiance(hdr);
+        return tonemapper.process(operators);
+    };
+    auto debevec_future = std::async(std::launch::async, tonemap, std::cref(hdr_debevec));
+    auto robertson_future = std::async(std::launch::async, tonemap, std::cref(hdr_robertson));
+    auto tonemapped_debevec{ debevec_future.get() };
+    auto tonemapped_robertson{ robertson_future.get() };
 
     // Create view for names and images of different exposures
     if (file_names.size() != images.size()) {
@@ -94,18 +88,14 @@ int main() {
         cv::imshow(name, image);
     }
 
-    cv::namedWindow("Drago Debevec", cv::WINDOW_NORMAL);
-    cv::namedWindow("Drago Robertson", cv::WINDOW_NORMAL);
-    cv::namedWindow("Reinhard Debevec", cv::WINDOW_NORMAL);
-    cv::namedWindow("Reinhard Robertson", cv::WINDOW_NORMAL);
-    cv::namedWindow("Mantiuk Debevec", cv::WINDOW_NORMAL);
-    cv::namedWindow("Mantiuk Robertson", cv::WINDOW_NORMAL);
-    cv::imshow("Drago Debevec", drago_debevec);
-    cv::imshow("Drago Robertson", drago_robertson);
-    cv::imshow("Reinhard Debevec", reinhard_debevec);
-    cv::imshow("Reinhard Robertson", reinhard_robertson);
-    cv::imshow("Mantiuk Debevec", mantiuk_debevec);
-    cv::imshow("Mantiuk Robertson", mantiuk_robertson);
+    for (std::size_t i{ 0 }; i < operators.size(); ++i) {
+        std::string debevec_name{ std::format("{} Debevec", operators[i].name) };
+        std::string robertson_name{ std::format("{} Robertson", operators[i].name) };
+        cv::namedWindow(debevec_name, cv::WINDOW_NORMAL);
+        cv::namedWindow(robertson_name, cv::WINDOW_NORMAL);
+        cv::imshow(debevec_name, tonemapped_debevec[i]);
+        cv::imshow(robertson_name, tonemapped_robertson[i]);
+    }
     cv::waitKey(0);
     cv::destroyAllWindows();
 
@@ -0,0 +1,76 @@
+#include <iostream>
+#include <opencv2/core.hpp>
+#include <opencv2/opencv.hpp>
+#include <opencv2/highgui.hpp>
+#include <stdexcept>
+#include <format>
+#include <print>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <thread>
+#include "hdr_engine.hpp"
+
+int main() {
+    // 1. Load images and set exposures
+    constexpr std::array<std::string, 4> file_names{ "img_0.033.jpg", "img_0.25.jpg", "img_2.5.jpg", "img_15.jpg" };
+    constexpr std::array<float, 4> all_times{ 1 / 30.0f, 0.25, 2.5, 15.0 };
+
+    std::vector<cv::Mat> images;
+    std::vector<float> times;
+    images.reserve(file_names.size());
+    times.reserve(file_names.size());
+    for (std::size_t i{ 0 }; i < file_names.size(); ++i) {
+        std::string path{ std::format("../data/images/{}", file_names[i]) };
+        cv::Mat image{ cv::imread(path) };
+        if (image.empty()) {
+            std::cerr << std::format("Can't load file from path: {}", path) << '\n';
+            continue;
+        }
+        images.emplace_back(std::move(image));
+        times.push_back(all_times[i]);
+    }
+
+    if (images.size() < 2) {
+        std::cerr << "At least two exposures are needed for HDR!\n";
+        return EXIT_FAILURE;
+    }
+
+    // 2. Alignment set of images
+    cv::Ptr<cv::AlignMTB> align_mtb{ cv::createAlignMTB() };
+    align_mtb->process(images, images);
+
+    // 3. Camera Response Function - calibrated once, then loaded from cache
+    auto start{ std::chrono::steady_clock::now() };
+    cv::Mat response;
+    try {
+        response = CameraResponse::loadOrCalibrate("../data/crf", "default", images, times);
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+    std::chrono::duration<double, std::milli> crf_time{ std::chrono::steady_clock::now() - start };
+
+    // 4. Merge and tone map band by band
+    HdrEngine engine{ response, 64 };
+    TonemapParams tonemap;
+    tonemap.gain = 3.0f;
+
+    start = std::chrono::steady_clock::now();
+    cv::Mat ldr{ engine.process(images, times, tonemap) };
+    std::chrono::duration<double, std::milli> merge_time{ std::chrono::steady_clock::now() - start };
+
+    auto threads{ static_cast<int>(std::thread::hardware_concurrency()) };
+    std::println("CRF: {:.2f} ms, merge + tone map: {:.2f} ms", crf_time.count(), merge_time.count());
+    std::println("Float buffers: {} KiB (band of {} rows x {} threads), full float radiance would be: {} KiB",
+        engine.peakBandBytes(ldr.cols, threads) / 1024, engine.getBandRows(), threads,
+        ldr.total() * sizeof(cv::Vec3f) / 1024);
+
+    cv::namedWindow("Streaming HDR", cv::WINDOW_NORMAL);
+    cv::imshow("Streaming HDR", ldr);
+    cv::waitKey(0);
+    cv::destroyAllWindows();
+
+    return 0;
+}
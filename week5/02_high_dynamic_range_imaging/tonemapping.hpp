@@ -0,0 +1,259 @@
+#pragma once
+
+#include <iostream>
+#include <opencv2/core.hpp>
+#include <opencv2/opencv.hpp>
+#include <opencv2/photo.hpp>
+#include <stdexcept>
+#include <format>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <future>
+#include <cmath>
+
+/// <summary>
+/// Global luminance statistics of a radiance map, needed by global tone mapping operators
+/// </summary>
+struct LuminanceStats {
+    double log_sum{ 0 };
+    double count{ 0 };
+    float max{ 0 };
+
+    void add(float luminance) {
+        log_sum += std::log(luminance + epsilon);
+        count += 1;
+        max = std::max(max, luminance);
+    }
+
+    void merge(const LuminanceStats& other) {
+        log_sum += other.log_sum;
+        count += other.count;
+        max = std::max(max, other.max);
+    }
+
+    /// <summary>
+    /// Geometric mean of luminance (log-average)
+    /// </summary>
+    float logAverage() const {
+        return count > 0 ? static_cast<float>(std::exp(log_sum / count)) : 1.0f;
+    }
+
+    static constexpr float epsilon{ 1e-6f };
+};
+
+inline float luminanceOf(const cv::Vec3f& bgr) {
+    return 0.114f * bgr[0] + 0.587f * bgr[1] + 0.299f * bgr[2];
+}
+
+/// <summary>
+/// Band-wise global operators follow the published formulas on absolute luminance, so they can run in a single pass
+/// from statistics of the whole map. They aren't cv::TonemapReinhard and cv::TonemapDrago, which min-max normalize
+/// the radiance before and the result after the operator, and their output differs.
+/// </summary>
+enum class TonemapType {
+    // Reinhard et al. 2002 global photographic operator: luminance scaled to the key value, burned out above
+    // the white point (the brightest pixel). cv::TonemapReinhard is the Reinhard-Devlin 2005 operator
+    // with intensity, light and colour adaptation.
+    ReinhardPhotographic,
+    // Drago et al. 2003 adaptive logarithmic mapping with display maximum of 100 cd/m^2, including its
+    // log10 normalization by the brightest pixel. cv::TonemapDrago leaves the normalization out and min-max
+    // normalizes the result instead.
+    DragoLogarithmic,
+    // cv::TonemapMantiuk
+    Mantiuk
+};
+
+/// <summary>
+/// Parameters of a tone mapping operator. Gain and conversion to 8-bit are applied in the same pass as the operator.
+/// </summary>
+struct TonemapParams {
+    TonemapType type{ TonemapType::ReinhardPhotographic };
+    std::string name{ "Reinhard photographic" };
+    float gamma{ 2.2f };
+    float saturation{ 1.0f };
+    float gain{ 1.0f };
+
+    // Reinhard photographic - key value of the scene
+    float key{ 0.18f };
+
+    // Drago logarithmic - bias of the logarithmic mapping
+    float bias{ 0.85f };
+
+    // Mantiuk - contrast scale
+    float scale{ 0.7f };
+
+    /// <summary>
+    /// Global operators can be evaluated band by band from shared statistics
+    /// </summary>
+    bool isGlobal() const {
+        return type != TonemapType::Mantiuk;
+    }
+};
+
+/// <summary>
+/// Tone maps a band of a radiance map straight into 8-bit output
+/// </summary>
+/// <param name="params">Operator and its parameters, must be a global operator</param>
+/// <param name="radiance_band">CV_32FC3 radiance</param>
+/// <param name="luminance_band">CV_32F luminance of the band, computed on the fly if empty</param>
+/// <param name="output_band">CV_8UC3 output with the same size as radiance_band</param>
+/// <param name="stats">Statistics of the whole radiance map</param>
+inline void tonemapBand(const TonemapParams& params, const cv::Mat& radiance_band, const cv::Mat& luminance_band,
+    cv::Mat& output_band, const LuminanceStats& stats) {
+    if (!params.isGlobal()) {
+        throw std::runtime_error(std::format("{} is not a global operator!\n", params.name));
+    }
+
+    const float inv_gamma{ 1.0f / params.gamma };
+    const float log_average{ stats.logAverage() };
+
+    // Reinhard photographic
+    const float scale{ params.key / log_average };
+    const float white{ std::max(stats.max * scale, 1.0f) };
+    const float inv_white_sq{ 1.0f / (white * white) };
+
+    // Drago logarithmic
+    const float normalized_max{ std::max(stats.max / log_average, LuminanceStats::epsilon) };
+    const float drago_norm{ 1.0f / std::log10(1.0f + normalized_max) };
+    const float drago_power{ std::log(params.bias) / std::log(0.5f) };
+
+    for (int y{ 0 }; y < radiance_band.rows; ++y) {
+        const auto* src{ radiance_band.ptr<cv::Vec3f>(y) };
+        const float* lum{ luminance_band.empty() ? nullptr : luminance_band.ptr<float>(y) };
+        auto* dst{ output_band.ptr<cv::Vec3b>(y) };
+
+        for (int x{ 0 }; x < radiance_band.cols; ++x) {
+            const auto& bgr{ src[x] };
+            const float luminance{ lum ? lum[x] : luminanceOf(bgr) };
+
+            float mapped{};
+            if (params.type == TonemapType::ReinhardPhotographic) {
+                float scaled{ luminance * scale };
+                mapped = scaled * (1.0f + scaled * inv_white_sq) / (1.0f + scaled);
+            }
+            else {
+                float normalized{ luminance / log_average };
+                float denominator{ std::log(2.0f + 8.0f * std::pow(normalized / normalized_max, drago_power)) };
+                mapped = drago_norm * std::log(1.0f + normalized) / denominator;
+            }
+
+            for (int c{ 0 }; c < 3; ++c) {
+                float ratio{ luminance > 0 ? bgr[c] / luminance : 0.0f };
+                float value{ std::pow(std::max(std::pow(ratio, params.saturation) * mapped, 0.0f), inv_gamma) * params.gain };
+                dst[x][c] = cv::saturate_cast<uchar>(value * 255.0f);
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Splits rows of an image into bands of band_rows rows, the last band may be shorter
+/// </summary>
+inline std::vector<cv::Range> makeBands(int rows, int band_rows) {
+    std::vector<cv::Range> bands;
+    bands.reserve((rows + band_rows - 1) / band_rows);
+    for (int y{ 0 }; y < rows; y += band_rows) {
+        bands.emplace_back(y, std::min(y + band_rows, rows));
+    }
+    return bands;
+}
+
+/// <summary>
+/// Computes luminance plane and its statistics once per radiance map and evaluates several
+/// tone mapping operators concurrently from that shared state.
+/// </summary>
+class SharedTonemapper {
+public:
+    SharedTonemapper(int band_rows = 64) : band_rows_(std::max(band_rows, 1)) {}
+
+    /// <summary>
+    /// Luminance plane and statistics, computed band by band in parallel
+    /// </summary>
+    void setRadiance(const cv::Mat& radiance) {
+        if (radiance.type() != CV_32FC3) {
+            throw std::runtime_error("Radiance map must be CV_32FC3!\n");
+        }
+        radiance_ = radiance;
+        luminance_.create(radiance.size(), CV_32F);
+
+        auto bands{ makeBands(radiance.rows, band_rows_) };
+        std::vector<LuminanceStats> band_stats(bands.size());
+        std::vector<std::size_t> indices(bands.size());
+        std::iota(indices.begin(), indices.end(), 0);
+        std::for_each(std::execution::par, indices.begin(), indices.end(), [&](std::size_t idx) {
+            for (int y{ bands[idx].start }; y < bands[idx].end; ++y) {
+                const auto* src{ radiance_.ptr<cv::Vec3f>(y) };
+                auto* dst{ luminance_.ptr<float>(y) };
+                for (int x{ 0 }; x < radiance_.cols; ++x) {
+                    dst[x] = luminanceOf(src[x]);
+                    band_stats[idx].add(dst[x]);
+                }
+            }
+            });
+
+        stats_ = {};
+        for (const auto& band : band_stats) {
+            stats_.merge(band);
+        }
+    }
+
+    const LuminanceStats& getStats() const {
+        return stats_;
+    }
+
+    const cv::Mat& getLuminance() const {
+        return luminance_;
+    }
+
+    /// <summary>
+    /// Evaluates every operator on its own thread, output is 8-bit with gain already applied
+    /// </summary>
+    std::vector<cv::Mat> process(const std::vector<TonemapParams>& operators) const {
+        if (radiance_.empty()) {
+            throw std::runtime_error("Set radiance map first!\n");
+        }
+
+        std::vector<std::future<cv::Mat>> futures;
+        futures.reserve(operators.size());
+        for (const auto& params : operators) {
+            futures.emplace_back(std::async(std::launch::async, [this, &params] { return apply(params); }));
+        }
+
+        std::vector<cv::Mat> results;
+        results.reserve(futures.size());
+        for (auto& future : futures) {
+            results.emplace_back(future.get());
+        }
+        return results;
+    }
+
+    cv::Mat apply(const TonemapParams& params) const {
+        cv::Mat output(radiance_.size(), CV_8UC3);
+
+        if (!params.isGlobal()) {
+            // Mantiuk works on gradients of the whole image and can't reuse global statistics,
+            // only gain and 8-bit conversion are fused into a single convertTo
+            cv::Mat mapped;
+            cv::Ptr<cv::TonemapMantiuk> tonemap_mantiuk{ cv::createTonemapMantiuk(params.gamma, params.scale, params.saturation) };
+            tonemap_mantiuk->process(radiance_, mapped);
+            mapped.convertTo(output, CV_8U, 255.0 * params.gain);
+            return output;
+        }
+
+        auto bands{ makeBands(radiance_.rows, band_rows_) };
+        std::for_each(std::execution::par, bands.begin(), bands.end(), [&](const cv::Range& rows) {
+            cv::Mat output_band{ output.rowRange(rows) };
+            tonemapBand(params, radiance_.rowRange(rows), luminance_.rowRange(rows), output_band, stats_);
+            });
+        return output;
+    }
+
+private:
+    int band_rows_;
+    cv::Mat radiance_;
+    cv::Mat luminance_;
+    LuminanceStats stats_;
+};
@@ -0,0 +1,321 @@
+#include <iostream>
+#include <opencv2/core.hpp>
+#include <opencv2/opencv.hpp>
+#include <opencv2/photo.hpp>
+#include <stdexcept>
+#include <format>
+#include <print>
+#include <vector>
+#include <filesystem>
+#include <array>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <future>
+#include <functional>
+#include <optional>
+#include <algorithm>
+#include <cmath>
+#include <ranges>
+
+class ThreadPool {
+public:
+    ThreadPool(unsigned int threads) {
+        threads = std::max(threads, 1u);
+        workers_.reserve(threads);
+        for (unsigned int i{ 0 }; i < threads; ++i) {
+            workers_.emplace_back(&ThreadPool::workerLoop, this);
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            keep_running_ = false;
+        }
+        cv_.notify_all();
+        for (auto& worker : workers_) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+    }
+
+    ThreadPool(const ThreadPool& other) = delete;
+    ThreadPool(ThreadPool&& other) = delete;
+    ThreadPool& operator=(const ThreadPool& other) = delete;
+    ThreadPool& operator=(ThreadPool&& other) = delete;
+
+    std::future<void> submit(std::function<void()> task) {
+        std::packaged_task<void()> packaged{ std::move(task) };
+        auto future{ packaged.get_future() };
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push(std::move(packaged));
+        }
+        cv_.notify_one();
+        return future;
+    }
+
+private:
+    std::vector<std::thread> workers_;
+    std::queue<std::packaged_task<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool keep_running_{ true };
+
+    void workerLoop() {
+        while (true) {
+            std::packaged_task<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return !keep_running_ || !tasks_.empty(); });
+                if (!keep_running_ && tasks_.empty()) {
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop();
+            }
+            task();
+        }
+    }
+};
+
+struct InpaintJob {
+    std::filesystem::path image_path;
+    std::filesystem::path mask_path;
+    cv::Mat img;
+    cv::Mat mask;
+};
+
+/// <summary>
+/// Start and end of every component task of an image, written by pool threads
+/// </summary>
+struct ComponentTimings {
+    using Clock = std::chrono::steady_clock;
+    std::vector<std::pair<Clock::time_point, Clock::time_point>> spans;
+
+    /// <summary>
+    /// From the start of the first task to the end of the last one
+    /// </summary>
+    std::chrono::duration<double, std::milli> latency() const {
+        if (spans.empty()) {
+            return {};
+        }
+        auto first{ std::ranges::min(spans | std::views::keys) };
+        auto last{ std::ranges::max(spans | std::views::values) };
+        return last - first;
+    }
+};
+
+class BatchInpainting {
+public:
+    BatchInpainting(const std::filesystem::path& images_dir, const std::filesystem::path& masks_dir,
+        const std::filesystem::path& output_dir, int flag, unsigned int threads)
+        : images_dir_(images_dir), masks_dir_(masks_dir), output_dir_(output_dir), flag_(flag), pool_(threads) {
+        if (!std::filesystem::is_directory(images_dir_)) {
+            throw std::runtime_error(std::format("Images directory doesn't exist: {}", images_dir_.string()));
+        }
+        if (!std::filesystem::is_directory(masks_dir_)) {
+            throw std::runtime_error(std::format("Masks directory doesn't exist: {}", masks_dir_.string()));
+        }
+        std::filesystem::create_directories(output_dir_);
+        collectPairs();
+    }
+
+    /// <summary>
+    /// Inpaints every image/mask pair. Connected components of a mask are inpainted concurrently on the pool,
+    /// while the next pair is loaded on the calling thread. Latency of an image is measured on the pool, from the start
+    /// of its first component to the end of its last one, so loading of the next pair isn't included.
+    /// A failed image is reported and skipped.
+    /// </summary>
+    void run() {
+        auto total_start{ std::chrono::steady_clock::now() };
+        std::size_t processed{ 0 };
+
+        std::optional<InpaintJob> next{ pairs_.empty() ? std::nullopt : load(0) };
+        for (std::size_t i{ 0 }; i < pairs_.size(); ++i) {
+            std::optional<InpaintJob> job{ std::move(next) };
+            next.reset();
+
+            if (!job) {
+                if (i + 1 < pairs_.size()) {
+                    next = load(i + 1);
+                }
+                continue;
+            }
+
+            cv::Mat result{ job->img.clone() };
+            ComponentTimings timings;
+            auto [futures, n_components] = inpaintComponents(*job, result, timings);
+
+            // Prefetch next pair while components are inpainted
+            if (i + 1 < pairs_.size()) {
+                next = load(i + 1);
+            }
+
+            // Every task has to finish before result and timings go out of scope, even if one of them failed
+            std::string error;
+            for (auto& future : futures) {
+                try {
+                    future.get();
+                }
+                catch (std::exception& e) {
+                    if (error.empty()) {
+                        error = e.what();
+                    }
+                }
+            }
+            if (!error.empty()) {
+                std::cerr << std::format("{}: inpainting failed: {}\n", job->image_path.filename().string(), error);
+                continue;
+            }
+
+            auto output_path{ output_dir_ / job->image_path.filename() };
+            if (!cv::imwrite(output_path.string(), result)) {
+                std::cerr << std::format("Can't write result to: {}\n", output_path.string());
+                continue;
+            }
+            ++processed;
+
+            std::println("{}: {} components, {}x{}, {:.2f} ms",
+                job->image_path.filename().string(), n_components, job->img.cols, job->img.rows, timings.latency().count());
+        }
+
+        std::chrono::duration<double> total{ std::chrono::steady_clock::now() - total_start };
+        std::println("Inpainted {} of {} images in {:.2f} s ({:.2f} images/s)",
+            processed, pairs_.size(), total.count(), total.count() > 0 ? processed / total.count() : 0.0);
+    }
+
+private:
+    std::filesystem::path images_dir_;
+    std::filesystem::path masks_dir_;
+    std::filesystem::path output_dir_;
+    int flag_;
+    ThreadPool pool_;
+
+    std::vector<std::pair<std::filesystem::path, std::filesystem::path>> pairs_;
+
+    static constexpr double inpaint_radius_{ 3 };
+    static constexpr std::array<std::string_view, 5> extensions_{ ".png", ".jpg", ".jpeg", ".bmp", ".tif" };
+
+    void collectPairs() {
+        for (const auto& entry : std::filesystem::directory_iterator(images_dir_)) {
+            if (!entry.is_regular_file()) {
+                continue;
+            }
+            auto mask_path{ findMask(entry.path()) };
+            if (!mask_path) {
+                std::cerr << std::format("There is no mask for: {}\n", entry.path().string());
+                continue;
+            }
+            pairs_.emplace_back(entry.path(), *mask_path);
+        }
+        std::ranges::sort(pairs_);
+    }
+
+    std::optional<std::filesystem::path> findMask(const std::filesystem::path& image_path) const {
+        // Mask has the same name as image, possibly with different extension
+        auto stem{ image_path.stem().string() };
+        for (const auto& extension : extensions_) {
+            auto candidate{ masks_dir_ / (stem + std::string(extension)) };
+            if (std::filesystem::exists(candidate)) {
+                return candidate;
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::optional<InpaintJob> load(std::size_t idx) const {
+        const auto& [image_path, mask_path] = pairs_.at(idx);
+        InpaintJob job{ image_path, mask_path, cv::imread(image_path.string()), cv::imread(mask_path.string(), cv::IMREAD_GRAYSCALE) };
+
+        if (job.img.empty() || job.mask.empty()) {
+            std::cerr << std::format("Can't load pair: {} and {}\n", image_path.string(), mask_path.string());
+            return std::nullopt;
+        }
+        if (job.img.size() != job.mask.size()) {
+            std::cerr << std::format("Image and mask have different sizes: {}\n", image_path.string());
+            return std::nullopt;
+        }
+
+        // Masks can be saved with compression artifacts, every non-zero pixel is damaged
+        cv::threshold(job.mask, job.mask, 0, 255, cv::THRESH_BINARY);
+        return job;
+    }
+
+    std::pair<std::vector<std::future<void>>, int> inpaintComponents(const InpaintJob& job, cv::Mat& result, ComponentTimings& timings) {
+        cv::Mat labels, stats, centroids;
+        auto n_labels{ cv::connectedComponentsWithStats(job.mask, labels, stats, centroids, 8, CV_32S) };
+
+        const cv::Rect image_rect{ 0, 0, job.img.cols, job.img.rows };
+        const int margin{ static_cast<int>(std::ceil(inpaint_radius_)) + 1 };
+
+        std::vector<std::future<void>> futures;
+        futures.reserve(std::max(n_labels - 1, 0));
+        // Every task writes only its own slot
+        timings.spans.assign(std::max(n_labels - 1, 0), {});
+
+        // Label 0 is background
+        for (int label{ 1 }; label < n_labels; ++label) {
+            cv::Rect component{
+                stats.at<int>(label, cv::CC_STAT_LEFT),
+                stats.at<int>(label, cv::CC_STAT_TOP),
+                stats.at<int>(label, cv::CC_STAT_WIDTH),
+                stats.at<int>(label, cv::CC_STAT_HEIGHT) };
+            cv::Rect roi{ cv::Rect(component.x - margin, component.y - margin,
+                component.width + 2 * margin, component.height + 2 * margin) & image_rect };
+
+            // Mats are captured by value (shared headers), result is written only on pixels owned by the label
+            auto* span{ &timings.spans[label - 1] };
+            futures.emplace_back(pool_.submit([img = job.img, mask = job.mask, labels, result, roi, label, flag = flag_, span]() mutable {
+                span->first = ComponentTimings::Clock::now();
+                span->second = span->first;
+                cv::Mat inpainted;
+                cv::inpaint(img(roi), mask(roi), inpainted, inpaint_radius_, flag);
+                inpainted.copyTo(result(roi), labels(roi) == label);
+                span->second = ComponentTimings::Clock::now();
+                }));
+        }
+
+        return { std::move(futures), std::max(n_labels - 1, 0) };
+    }
+};
+
+int main(int argc, char** argv) {
+    // Usage: batch_image_inpainting <images_dir> <masks_dir> <output_dir> [ns|telea] [threads]
+    std::filesystem::path images_dir{ argc > 1 ? argv[1] : "../data/images/inpainting" };
+    std::filesystem::path masks_dir{ argc > 2 ? argv[2] : "../data/images/inpainting_masks" };
+    std::filesystem::path output_dir{ argc > 3 ? argv[3] : "../data/images/inpainting_output" };
+    std::string method{ argc > 4 ? argv[4] : "telea" };
+    unsigned int threads{ argc > 5 ? static_cast<unsigned int>(std::stoul(argv[5])) : std::thread::hardware_concurrency() };
+
+    int flag{};
+    if (method == "ns") {
+        flag = cv::INPAINT_NS;
+    }
+    else if (method == "telea") {
+        flag = cv::INPAINT_TELEA;
+    }
+    else {
+        std::cerr << std::format("Unknown method: {}, use ns or telea\n", method);
+        return EXIT_FAILURE;
+    }
+
+    // Every component runs on its own pool thread
+    cv::setNumThreads(1);
+
+    try {
+        BatchInpainting batch{ images_dir, masks_dir, output_dir, flag, threads };
+        batch.run();
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return 0;
+}
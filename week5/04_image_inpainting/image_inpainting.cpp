@@ -8,6 +8,10 @@
 #include <vector>
 #include <filesystem>
 #include <array>
+#include <map>
+#include <algorithm>
+#include <execution>
+#include <numeric>
 
 class ImageInpainting {
 public:
@@ -19,11 +23,79 @@ public:
         mask_ = cv::Mat::zeros(img_.size(), CV_8U);
     }
 
+    /// <summary>
+    /// Inpaints only the part of the image that changed since the last call with the same flag.
+    /// Result for every flag is cached, dirty area is split into connected components of the mask
+    /// and every component is inpainted in its own ROI (extended by inpaint radius) in parallel.
+    /// </summary>
+    /// <param name="flag">Inpainting method (cv::INPAINT_NS or cv::INPAINT_TELEA)</param>
+    /// <returns>Cached, up to date inpainted image</returns>
     cv::Mat process(int flag) {
-        cv::Mat processed_;
-        cv::inpaint(img_, mask_, processed_, 3, flag);
+        auto [it, inserted] = cache_.try_emplace(flag);
+        auto& cache = it->second;
+        if (inserted) {
+            // First request for this method - everything drawn so far is dirty
+            cache.result = img_.clone();
+            cache.dirty = cv::boundingRect(mask_);
+        }
+
+        if (cache.dirty.empty()) {
+            return cache.result;
+        }
+
+        const cv::Rect image_rect{ 0, 0, img_.cols, img_.rows };
+        const int margin{ static_cast<int>(std::ceil(inpaint_radius_)) + 1 };
+        cv::Rect dirty{ extendRect(cache.dirty, margin) & image_rect };
+        cache.dirty = {};
+        if (dirty.empty()) {
+            return cache.result;
+        }
+
+        // Split dirty part of the mask into separate components
+        cv::Mat labels, stats, centroids;
+        auto n_components{ cv::connectedComponentsWithStats(mask_(dirty), labels, stats, centroids, 8, CV_32S) };
+
+        // Label 0 is background
+        std::vector<int> components(std::max(n_components - 1, 0));
+        std::iota(components.begin(), components.end(), 1);
+
+        std::for_each(std::execution::par, components.begin(), components.end(), [&](int label) {
+            cv::Rect component{
+                stats.at<int>(label, cv::CC_STAT_LEFT) + dirty.x,
+                stats.at<int>(label, cv::CC_STAT_TOP) + dirty.y,
+                stats.at<int>(label, cv::CC_STAT_WIDTH),
+                stats.at<int>(label, cv::CC_STAT_HEIGHT) };
+            cv::Rect roi{ extendRect(component, margin) & image_rect };
+
+            cv::Mat inpainted;
+            cv::inpaint(img_(roi), mask_(roi), inpainted, inpaint_radius_, flag);
+
+            // Write back only pixels owned by this component, so parallel writes never overlap
+            cv::Mat owned{ cv::Mat::zeros(roi.size(), CV_8U) };
+            cv::Rect local{ component - roi.tl() };
+            cv::Mat own_labels{ labels(component - dirty.tl()) == label };
+            own_labels.copyTo(owned(local));
+            inpainted.copyTo(cache.result(roi), owned);
+            });
+
+        return cache.result;
+    }
 
-        return processed_;
+    /// <summary>
+    /// Marks area covered by a new stroke as dirty for every cached inpainting result
+    /// </summary>
+    /// <param name="from">Start point of the stroke</param>
+    /// <param name="to">End point of the stroke</param>
+    /// <param name="thickness">Thickness of the stroke</param>
+    void markDirty(const cv::Point& from, const cv::Point& to, int thickness) {
+        cv::Rect stroke{ extendRect(cv::Rect(from, to), thickness + 1) };
+        for (auto& [flag, cache] : cache_) {
+            cache.dirty = cache.dirty.empty() ? stroke : (cache.dirty | stroke);
+        }
+    }
+
+    void resetCache() {
+        cache_.clear();
     }
 
     const cv::Mat& getImg() const {
@@ -80,11 +152,20 @@ public:
     }
 
 private:
+    struct InpaintCache {
+        cv::Mat result;
+        cv::Rect dirty;
+    };
+
     // Matrices for images
     cv::Mat img_;
     cv::Mat mask_;
     cv::Mat copy_;
 
+    // Inpainted images for every method with area changed since they were computed
+    std::map<int, InpaintCache> cache_;
+    static constexpr double inpaint_radius_{ 3 };
+
     // Point for drawing purpose
     cv::Point previous_point_{ -1, -1 };
 
@@ -100,6 +181,10 @@ private:
     // Line thickness
     int line_thickness{ 1 };
     const int max_line_thickness{ 20 };
+
+    static cv::Rect extendRect(const cv::Rect& rect, int margin) {
+        return { rect.x - margin, rect.y - margin, rect.width + 2 * margin, rect.height + 2 * margin };
+    }
 };
 
 void drawLine(int event, int x, int y, int flags, void* data) {
@@ -136,6 +221,7 @@ void drawLine(int event, int x, int y, int flags, void* data) {
             ii->getLineThickness(),
             ii->getTypeOfLine(ii->getLineIdx()));
 
+        ii->markDirty(ii->getPreviousPoint(), pt, ii->getLineThickness());
         ii->setPreviousPoint(pt);
 
         cv::imshow(ii->getOriginalName(), ii->getImg());
@@ -184,6 +270,7 @@ int main() {
         if (c == 'r') {
             ii.getMask() = cv::Scalar::all(0);
             ii.setImg(ii.getCopy());
+            ii.resetCache();
             try {
                 cv::destroyWindow("Navier-Stokes based method");
                 cv::destroyWindow("Fast marching based method");
@@ -7,6 +7,8 @@
 #include <format>
 #include <filesystem>
 #include <vector>
+#include <memory>
+#include "../../week2/01_video_io/frame_source.hpp"
 
 class ColorPatchSelector {
 public:
@@ -146,10 +148,12 @@ void colorSelector(int event, int x, int y, int flags, void* data) {
 }
 
 int main() {
-    cv::VideoCapture cap;
     std::filesystem::path video_path{ "../data/videos/greenscreen-asteroid.mp4" };
-    cap.open(video_path.string());
-    if (!cap.isOpened()) {
+    std::unique_ptr<FrameSource> source;
+    try {
+        source = std::make_unique<FrameSource>(video_path.string());
+    }
+    catch (std::exception& e) {
         std::cerr << std::format("Can't load video from: {}\n", video_path.string());
         return EXIT_FAILURE;
     }
@@ -166,11 +170,10 @@ int main() {
     cv::createTrackbar("Blur", sm.getImageWindowName(), &sm.blur_idx, sm.max_blur - 1);
     cv::createTrackbar("Erode", sm.getImageWindowName(), &sm.erode_idx, sm.max_erode - 1);
 
-    while (true) {
-        cap.read(sm.getImg());
-        if (sm.getImg().empty()) {
-            break;
-        }
+    while (auto frame = source->next()) {
+        // Processing works in place, so the decoded buffer is copied into image reused between frames
+        frame->image().copyTo(sm.getImg());
+        frame->release();
         sm.convertToLab();
         sm.setMask();
 
@@ -189,7 +192,7 @@ int main() {
         cv::imshow("Background", sm.getBackground());
     }
 
-    cap.release();
+    source->stop();
     cv::destroyAllWindows();
 
 
@@ -6,6 +6,16 @@
 #include <expected>
 #include <vector>
 #include <filesystem>
+#include <format>
+#include <print>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <functional>
+#include <thread>
+#include <array>
 
 class DetectCornersToTrack {
 public:
@@ -30,9 +40,16 @@ public:
         k_ = k;
 
         is_set = true;
+        cells_.clear();
     }
 
-    std::expected<std::vector<cv::Point2f>, std::string> getPoints(const cv::Mat& gray) {
+    /// <summary>
+    /// Function that detects corners in the given image
+    /// </summary>
+    /// <param name="gray">Single channel image</param>
+    /// <param name="mask">Optional region of interest, overrides mask given in setParams</param>
+    /// <param name="max_corners">Optional maximum number of corners, overrides value given in setParams</param>
+    std::expected<std::vector<cv::Point2f>, std::string> getPoints(const cv::Mat& gray, const cv::Mat& mask = {}, int max_corners = 0) {
         if (!is_set) {
             return std::unexpected{ "Set parameters first!\n" };
         }
@@ -49,10 +66,10 @@ public:
 
         cv::goodFeaturesToTrack(gray,
             points_,
-            max_corners_,
+            max_corners > 0 ? max_corners : max_corners_,
             quality_level_,
             min_distance_,
-            mask_,
+            mask.empty() ? mask_ : mask,
             block_size_,
             use_harris_detector_,
             k_);
@@ -60,8 +77,210 @@ public:
         return points_;
     }
 
+    /// <summary>
+    /// Function that detects new corners only in cells of a grid that don't contain any live track.
+    /// The grid is kept between calls and corner response is evaluated (in parallel) only in cells vacated since
+    /// the previous call, so the cost scales with the lost area. Cells that yielded no corner are retired and
+    /// evaluated again only every retired_refresh_ calls.
+    /// The quality threshold is relative to the best response around live tracks and in the evaluated cells,
+    /// not to the best corner of a single (possibly flat) cell.
+    /// The mask given in setParams applies to the response, non-maximum suppression sees one pixel across cell borders.
+    /// </summary>
+    /// <param name="gray">Single channel image</param>
+    /// <param name="live_points">Points that are still tracked</param>
+    /// <param name="cell_size">Size of a grid cell in pixels</param>
+    /// <param name="max_per_cell">Maximum number of new corners in a single cell</param>
+    /// <param name="max_corners">Maximum number of returned corners, the strongest are kept</param>
+    std::expected<std::vector<cv::Point2f>, std::string> getPointsInEmptyCells(const cv::Mat& gray,
+        const std::vector<cv::Point2f>& live_points, int cell_size, int max_per_cell, int max_corners) {
+        if (!is_set) {
+            return std::unexpected{ "Set parameters first!\n" };
+        }
+
+        if (gray.empty()) {
+            return std::unexpected{ "Given image is empty!\n" };
+        }
+
+        if (gray.channels() != 1) {
+            return std::unexpected{ std::format("Mismatch number of channels, expected 1, given: {}", gray.channels()) };
+        }
+
+        if (cell_size <= 0 || max_per_cell <= 0 || max_corners <= 0) {
+            return std::vector<cv::Point2f>{};
+        }
+
+        // Grid survives between calls, it starts again if the geometry changes
+        cv::Size grid{ (gray.cols + cell_size - 1) / cell_size, (gray.rows + cell_size - 1) / cell_size };
+        if (grid != grid_ || cell_size != grid_cell_size_ || static_cast<int>(cells_.size()) != grid.area()) {
+            grid_ = grid;
+            grid_cell_size_ = cell_size;
+            cells_.assign(grid.area(), CellState::Vacant);
+            calls_since_refresh_ = 0;
+        }
+        else if (++calls_since_refresh_ >= retired_refresh_) {
+            std::ranges::replace(cells_, CellState::Retired, CellState::Vacant);
+            calls_since_refresh_ = 0;
+        }
+
+        // Live points bucketed by cells, to find vacated cells and check distance to neighbours
+        auto cellOf = [&](const cv::Point2f& point) {
+            int cx{ std::clamp(static_cast<int>(point.x) / cell_size, 0, grid.width - 1) };
+            int cy{ std::clamp(static_cast<int>(point.y) / cell_size, 0, grid.height - 1) };
+            return cy * grid.width + cx;
+        };
+        std::vector<std::vector<cv::Point2f>> buckets(grid.area());
+        for (const auto& point : live_points) {
+            buckets[cellOf(point)].push_back(point);
+        }
+
+        std::vector<int> vacant_cells;
+        for (int idx{ 0 }; idx < grid.area(); ++idx) {
+            if (!buckets[idx].empty()) {
+                cells_[idx] = CellState::Occupied;
+                continue;
+            }
+            if (cells_[idx] == CellState::Occupied) {
+                cells_[idx] = CellState::Vacant;
+            }
+            if (cells_[idx] == CellState::Vacant) {
+                vacant_cells.push_back(idx);
+            }
+        }
+
+        if (vacant_cells.empty()) {
+            return std::vector<cv::Point2f>{};
+        }
+
+        const cv::Mat mask{ mask_.size() == gray.size() ? mask_ : cv::Mat{} };
+        const cv::Rect image{ 0, 0, gray.cols, gray.rows };
+
+        // Response of the ROI uses real neighbouring pixels of the image as a border
+        auto maskedResponse = [&](const cv::Rect& area, cv::Mat& response) {
+            cornerResponse(gray(area), response);
+            if (!mask.empty()) {
+                response.setTo(0, mask(area) == 0);
+            }
+        };
+
+        // 1. Response of every vacated cell, with one more pixel around the cell,
+        // so maxima on the cell border are compared with pixels of the neighbours
+        std::vector<cv::Rect> cells(vacant_cells.size());
+        std::vector<cv::Rect> areas(vacant_cells.size());
+        std::vector<cv::Mat> responses(vacant_cells.size());
+        std::vector<double> best_responses(vacant_cells.size(), 0);
+        std::vector<std::size_t> indices(vacant_cells.size());
+        std::iota(indices.begin(), indices.end(), 0);
+
+        std::for_each(std::execution::par, indices.begin(), indices.end(), [&](std::size_t i) {
+            int cx{ vacant_cells[i] % grid.width };
+            int cy{ vacant_cells[i] / grid.width };
+            cells[i] = cv::Rect(cx * cell_size, cy * cell_size, cell_size, cell_size) & image;
+            areas[i] = cv::Rect(cells[i].x - 1, cells[i].y - 1, cells[i].width + 2, cells[i].height + 2) & image;
+            maskedResponse(areas[i], responses[i]);
+            cv::minMaxLoc(responses[i], nullptr, &best_responses[i]);
+            });
+
+        // 2. Quality threshold must be global. Tracks sit on the strongest corners, so a small patch around every live
+        // point together with the evaluated cells stands for the full frame at a cost proportional to the points
+        double reference{ std::ranges::max(best_responses) };
+        const int radius{ block_size_ / 2 + 1 };
+        for (const auto& point : live_points) {
+            const cv::Rect patch{ cv::Rect(cvRound(point.x) - radius, cvRound(point.y) - radius, 2 * radius + 1, 2 * radius + 1) & image };
+            if (patch.empty()) {
+                continue;
+            }
+            cv::Mat response;
+            maskedResponse(patch, response);
+            double best{ 0 };
+            cv::minMaxLoc(response, nullptr, &best);
+            reference = std::max(reference, best);
+        }
+        const double threshold{ quality_level_ * reference };
+
+        // 3. Local maxima above the threshold in every cell
+        std::vector<std::vector<std::pair<float, cv::Point2f>>> cell_corners(vacant_cells.size());
+        std::for_each(std::execution::par, indices.begin(), indices.end(), [&](std::size_t i) {
+            int cx{ vacant_cells[i] % grid.width };
+            int cy{ vacant_cells[i] / grid.width };
+            const auto& cell{ cells[i] };
+            const auto& area{ areas[i] };
+            const auto& response{ responses[i] };
+
+            cv::Mat dilated;
+            cv::dilate(response, dilated, cv::Mat());
+            std::vector<std::pair<float, cv::Point2f>> candidates;
+            for (int y{ cell.y - area.y }; y < cell.y - area.y + cell.height; ++y) {
+                const auto* r{ response.ptr<float>(y) };
+                const auto* d{ dilated.ptr<float>(y) };
+                for (int x{ cell.x - area.x }; x < cell.x - area.x + cell.width; ++x) {
+                    if (r[x] > threshold && r[x] == d[x]) {
+                        candidates.emplace_back(r[x], cv::Point2f(static_cast<float>(x + area.x), static_cast<float>(y + area.y)));
+                    }
+                }
+            }
+            std::ranges::sort(candidates, std::greater{}, &std::pair<float, cv::Point2f>::first);
+
+            // Keep the strongest corners which are far enough from each other and from live tracks in neighbouring cells
+            const double min_distance_sq{ min_distance_ * min_distance_ };
+            auto isFar = [min_distance_sq](const cv::Point2f& a, const cv::Point2f& b) {
+                cv::Point2f diff{ a - b };
+                return diff.dot(diff) >= min_distance_sq;
+            };
+            auto& selected{ cell_corners[i] };
+            for (const auto& candidate : candidates) {
+                if (static_cast<int>(selected.size()) >= max_per_cell) {
+                    break;
+                }
+                bool accepted{ std::ranges::all_of(selected, [&](const auto& s) { return isFar(s.second, candidate.second); }) };
+                for (int ny{ std::max(cy - 1, 0) }; accepted && ny <= std::min(cy + 1, grid.height - 1); ++ny) {
+                    for (int nx{ std::max(cx - 1, 0) }; accepted && nx <= std::min(cx + 1, grid.width - 1); ++nx) {
+                        accepted = std::ranges::all_of(buckets[ny * grid.width + nx], [&](const auto& p) { return isFar(p, candidate.second); });
+                    }
+                }
+                if (accepted) {
+                    selected.push_back(candidate);
+                }
+            }
+
+            // Flat cell isn't evaluated again until the refresh
+            if (selected.empty()) {
+                cells_[vacant_cells[i]] = CellState::Retired;
+            }
+            });
+
+        // Corners from neighbouring empty cells can still be too close to each other, strongest wins
+        std::vector<std::pair<float, cv::Point2f>> all_corners;
+        for (const auto& corners : cell_corners) {
+            all_corners.insert(all_corners.end(), corners.begin(), corners.end());
+        }
+        std::ranges::sort(all_corners, std::greater{}, &std::pair<float, cv::Point2f>::first);
+
+        points_.clear();
+        const double min_distance_sq{ min_distance_ * min_distance_ };
+        for (const auto& [response, point] : all_corners) {
+            if (static_cast<int>(points_.size()) >= max_corners) {
+                break;
+            }
+            bool accepted{ std::ranges::all_of(points_, [&](const cv::Point2f& p) {
+                cv::Point2f diff{ p - point };
+                return diff.dot(diff) >= min_distance_sq;
+                }) };
+            if (accepted) {
+                points_.push_back(point);
+                cells_[cellOf(point)] = CellState::Occupied;
+            }
+        }
+
+        return points_;
+    }
+
     void resetParams() {
         is_set = false;
+        cells_.clear();
+    }
+
+    int getMaxCorners() const {
+        return max_corners_;
     }
 
 private:
@@ -75,11 +294,34 @@ private:
 
     bool is_set{ false };
 
+    // Re-seeding grid kept between calls. Vacant cells lost their tracks and are evaluated on the next call,
+    // retired cells yielded no corner and wait for the refresh
+    enum class CellState : uchar { Occupied, Vacant, Retired };
+    std::vector<CellState> cells_;
+    cv::Size grid_{};
+    int grid_cell_size_{ 0 };
+    int calls_since_refresh_{ 0 };
+    static constexpr int retired_refresh_{ 10 };
+
     std::vector<cv::Point2f> points_;
+
+    void cornerResponse(const cv::Mat& gray, cv::Mat& response) const {
+        if (use_harris_detector_) {
+            cv::cornerHarris(gray, response, block_size_, 3, k_);
+        }
+        else {
+            cv::cornerMinEigenVal(gray, response, block_size_, 3);
+        }
+    }
 };
 
 class OpticalFlow {
 public:
+    OpticalFlow(cv::Size win_size = { 15, 15 }, int max_level = 2, int cell_size = 40)
+        : win_size_(win_size), max_level_(max_level), cell_size_(cell_size) {
+        setGoodFeaturesToTrack();
+    }
+
     void setGoodFeaturesToTrack(int max_corners = 100, double quality_level = 0.3, double min_distance = 7,
         cv::Mat mask = {}, int block_size = 3, bool use_harris_detector = false, double k = 0.04) {
         track_.setParams(max_corners, quality_level, min_distance, mask, block_size, use_harris_detector, k);
@@ -89,29 +331,61 @@ public:
         track_.resetParams();
     }
 
+    /// <summary>
+    /// Tracks points from the previous frame with pyramidal Lucas-Kanade. Corners are detected only for the first frame,
+    /// later lost points are re-seeded only in grid cells without any tracked point.
+    /// Pyramid of the previous frame is reused, so every frame builds only one pyramid.
+    /// </summary>
+    /// <param name="frame">Next BGR frame</param>
     void process(const cv::Mat& frame) {
         if (!checkCorrectness(frame)) {
             throw std::runtime_error("Can't process your frame!\n");
         }
         getNextImg(frame);
-        setGoodFeaturesToTrack();
-        auto expected = track_.getPoints(new_gray_);
-
-        if (!expected) {
-            throw std::runtime_error("Can't get good features to track!\n");
-        }
+        cv::buildOpticalFlowPyramid(new_gray_, new_pyramid_, win_size_, max_level_);
 
-        old_points_ = expected.value();
+        good_old_points_.clear();
+        good_new_points_.clear();
 
         if (first_image) {
             first_image = false;
-            old_gray_ = new_gray_.clone();
+            old_points_ = detect({});
+            swapFrames();
             return;
         }
 
+        if (!old_points_.empty()) {
+            cv::calcOpticalFlowPyrLK(old_pyramid_, new_pyramid_, old_points_, new_points_, status_, errors_, win_size_, max_level_);
+
+            for (std::size_t i{ 0 }; i < old_points_.size(); ++i) {
+                if (status_[i]) {
+                    good_old_points_.push_back(old_points_[i]);
+                    good_new_points_.push_back(new_points_[i]);
+                }
+            }
+        }
+        tracked_points_ += good_new_points_.size();
+
+        old_points_ = good_new_points_;
+        reseed();
+        swapFrames();
     }
 
+    const std::vector<cv::Point2f>& getGoodOldPoints() const {
+        return good_old_points_;
+    }
+
+    const std::vector<cv::Point2f>& getGoodNewPoints() const {
+        return good_new_points_;
+    }
+
+    std::size_t getTrackedPoints() const {
+        return tracked_points_;
+    }
 
+    std::size_t getSeededPoints() const {
+        return seeded_points_;
+    }
 
 private:
     // Images
@@ -119,6 +393,12 @@ private:
     cv::Mat old_gray_;
     cv::Mat new_gray_;
 
+    // Pyramids, pyramid of the new frame becomes the old one for the next frame
+    std::vector<cv::Mat> old_pyramid_;
+    std::vector<cv::Mat> new_pyramid_;
+    cv::Size win_size_;
+    int max_level_;
+
     std::vector<cv::Point2f> old_points_;
     std::vector<cv::Point2f> new_points_;
 
@@ -130,11 +410,19 @@ private:
 
     DetectCornersToTrack track_;
 
+    // Re-seeding grid
+    int cell_size_;
+    static constexpr int max_per_cell_{ 2 };
+
+    // Statistics
+    std::size_t tracked_points_{ 0 };
+    std::size_t seeded_points_{ 0 };
+
     bool first_image = true;
 
 
     void getNextImg(const cv::Mat& frame) {
-        img_ = frame.clone();
+        img_ = frame;
         convertToGray(img_);
     }
 
@@ -142,20 +430,302 @@ private:
         cv::cvtColor(img, new_gray_, cv::COLOR_BGR2GRAY);
     }
 
-    bool checkCorrectness(const cv::Mat& frame) {
-        if (frame.channels() != 3) {
-            std::cerr << "Frame must be in BGR format!\n";
-            return false;
+    void swapFrames() {
+        std::swap(old_gray_, new_gray_);
+        std::swap(old_pyramid_, new_pyramid_);
+    }
+
+    std::vector<cv::Point2f> detect(const cv::Mat& mask, int max_corners = 0) {
+        auto expected = track_.getPoints(new_gray_, mask, max_corners);
+
+        if (!expected) {
+            throw std::runtime_error(std::format("Can't get good features to track: {}", expected.error()));
+        }
+        seeded_points_ += expected.value().size();
+        return expected.value();
+    }
+
+    /// <summary>
+    /// Adds new corners only in cells of the grid that don't contain any tracked point
+    /// </summary>
+    void reseed() {
+        int missing{ track_.getMaxCorners() - static_cast<int>(old_points_.size()) };
+        if (missing <= 0) {
+            return;
         }
+
+        auto expected = track_.getPointsInEmptyCells(new_gray_, old_points_, cell_size_, max_per_cell_, missing);
+        if (!expected) {
+            throw std::runtime_error(std::format("Can't re-seed points to track: {}", expected.error()));
+        }
+        seeded_points_ += expected.value().size();
+        old_points_.insert(old_points_.end(), expected.value().begin(), expected.value().end());
+    }
+
+    bool checkCorrectness(const cv::Mat& frame) {
         if (frame.empty()) {
             std::cerr << "Frame is empty!\n";
             return false;
         }
+        if (frame.channels() != 3) {
+            std::cerr << "Frame must be in BGR format!\n";
+            return false;
+        }
         return true;
     }
 };
 
-int main() {
+class DenseOpticalFlow {
+public:
+    /// <summary>
+    /// Dense Farneback optical flow. A single band uses the threads of cv::calcOpticalFlowFarneback itself.
+    /// More bands run on separate threads with OpenCV threading switched off, every band is extended by a margin
+    /// for the coarsest pyramid level, so more pixels are computed than the image has (see getBandOverhead).
+    /// </summary>
+    /// <param name="levels">Number of pyramid levels, 0 means only the original image</param>
+    /// <param name="bands">Number of row bands, 0 means one band per hardware thread</param>
+    /// <param name="preview_scale">Scale of additional low-resolution flow, 0 disables preview</param>
+    DenseOpticalFlow(int levels = 3, int bands = 1, double preview_scale = 0.0)
+        : levels_(std::max(levels, 0)), bands_(bands > 0 ? bands : static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u))),
+        preview_scale_(preview_scale) {}
+
+    /// <summary>
+    /// Calculates flow between previous and given frame. For the first frame flow is empty.
+    /// </summary>
+    /// <param name="frame">Next BGR frame</param>
+    void process(const cv::Mat& frame) {
+        if (frame.empty() || frame.channels() != 3) {
+            throw std::runtime_error("Frame must be a non-empty BGR image!\n");
+        }
+        cv::cvtColor(frame, new_gray_, cv::COLOR_BGR2GRAY);
+
+        if (!old_gray_.empty()) {
+            auto start{ std::chrono::steady_clock::now() };
+            calculateBands(old_gray_, new_gray_, flow_);
+            full_time_ += std::chrono::steady_clock::now() - start;
+            ++full_frames_;
+
+            if (preview_scale_ > 0) {
+                start = std::chrono::steady_clock::now();
+                cv::resize(new_gray_, new_preview_, {}, preview_scale_, preview_scale_, cv::INTER_AREA);
+                if (!old_preview_.empty()) {
+                    calculateBands(old_preview_, new_preview_, preview_flow_);
+                }
+                preview_time_ += std::chrono::steady_clock::now() - start;
+                ++preview_frames_;
+            }
+        }
+        else if (preview_scale_ > 0) {
+            cv::resize(new_gray_, new_preview_, {}, preview_scale_, preview_scale_, cv::INTER_AREA);
+        }
+
+        std::swap(old_gray_, new_gray_);
+        std::swap(old_preview_, new_preview_);
+    }
+
+    const cv::Mat& getFlow() const {
+        return flow_;
+    }
+
+    const cv::Mat& getPreviewFlow() const {
+        return preview_flow_;
+    }
+
+    double getFps() const {
+        return full_time_.count() > 0 ? full_frames_ / full_time_.count() : 0.0;
+    }
+
+    double getPreviewFps() const {
+        return preview_time_.count() > 0 ? preview_frames_ / preview_time_.count() : 0.0;
+    }
+
+    /// <summary>
+    /// Rows computed by all bands over rows of the images, 1 for a single band
+    /// </summary>
+    double getBandOverhead() const {
+        return image_rows_ > 0 ? static_cast<double>(computed_rows_) / image_rows_ : 1.0;
+    }
+
+    /// <summary>
+    /// Flow visualization - direction as hue, magnitude as value
+    /// </summary>
+    static cv::Mat visualize(const cv::Mat& flow) {
+        if (flow.empty()) {
+            return {};
+        }
+        std::array<cv::Mat, 2> xy;
+        cv::split(flow, xy);
+
+        cv::Mat magnitude, angle;
+        cv::cartToPolar(xy[0], xy[1], magnitude, angle, true);
+        cv::normalize(magnitude, magnitude, 0, 255, cv::NORM_MINMAX);
+
+        std::array<cv::Mat, 3> hsv_channels;
+        angle.convertTo(hsv_channels[0], CV_8U, 0.5);
+        hsv_channels[1] = cv::Mat(flow.size(), CV_8U, cv::Scalar(255));
+        magnitude.convertTo(hsv_channels[2], CV_8U);
+
+        cv::Mat hsv, bgr;
+        cv::merge(hsv_channels, hsv);
+        cv::cvtColor(hsv, bgr, cv::COLOR_HSV2BGR);
+        return bgr;
+    }
+
+private:
+    cv::Mat old_gray_;
+    cv::Mat new_gray_;
+    cv::Mat old_preview_;
+    cv::Mat new_preview_;
+    cv::Mat flow_;
+    cv::Mat preview_flow_;
+
+    int levels_;
+    int bands_;
+    double preview_scale_;
+
+    // Farneback parameters
+    static constexpr double pyr_scale_{ 0.5 };
+    static constexpr int win_size_{ 15 };
+    static constexpr int iterations_{ 3 };
+    static constexpr int poly_n_{ 5 };
+    static constexpr double poly_sigma_{ 1.2 };
+
+    // Statistics
+    std::chrono::duration<double> full_time_{ 0 };
+    std::chrono::duration<double> preview_time_{ 0 };
+    std::size_t full_frames_{ 0 };
+    std::size_t preview_frames_{ 0 };
+    std::size_t computed_rows_{ 0 };
+    std::size_t image_rows_{ 0 };
+
+    /// <summary>
+    /// Every band is extended by a margin large enough for the coarsest pyramid level,
+    /// flow is calculated on the extended band and only its inner rows are kept
+    /// </summary>
+    void calculateBands(const cv::Mat& prev, const cv::Mat& next, cv::Mat& flow) {
+        flow.create(prev.size(), CV_32FC2);
+        image_rows_ += prev.rows;
+
+        const int margin{ (win_size_ + poly_n_) * (1 << levels_) };
+        const int bands{ std::clamp(prev.rows / std::max(margin, 1), 1, bands_) };
+        if (bands == 1) {
+            computed_rows_ += prev.rows;
+            cv::calcOpticalFlowFarneback(prev, next, flow, pyr_scale_, levels_ + 1, win_size_, iterations_, poly_n_, poly_sigma_, 0);
+            return;
+        }
+        const int band_rows{ (prev.rows + bands - 1) / bands };
+
+        std::vector<cv::Range> ranges;
+        for (int y{ 0 }; y < prev.rows; y += band_rows) {
+            ranges.emplace_back(y, std::min(y + band_rows, prev.rows));
+            computed_rows_ += std::min(y + band_rows + margin, prev.rows) - std::max(y - margin, 0);
+        }
+
+        // Bands already use every thread, OpenCV threads inside them would only oversubscribe the cores
+        const int opencv_threads{ cv::getNumThreads() };
+        cv::setNumThreads(1);
+        std::for_each(std::execution::par, ranges.begin(), ranges.end(), [&](const cv::Range& rows) {
+            cv::Range extended{ std::max(rows.start - margin, 0), std::min(rows.end + margin, prev.rows) };
+            cv::Mat band_flow;
+            cv::calcOpticalFlowFarneback(prev.rowRange(extended), next.rowRange(extended), band_flow,
+                pyr_scale_, levels_ + 1, win_size_, iterations_, poly_n_, poly_sigma_, 0);
+            band_flow.rowRange(rows.start - extended.start, rows.end - extended.start).copyTo(flow.rowRange(rows));
+            });
+        cv::setNumThreads(opencv_threads);
+    }
+};
+
+void runSparse(cv::VideoCapture& cap, cv::VideoWriter& out, int width, int height) {
+    OpticalFlow flow;
+    // Random colors for tracks
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<> dist(0, 255);
+    std::vector<cv::Scalar> colors(100);
+    std::ranges::generate(colors, [&] { return cv::Scalar(dist(gen), dist(gen), dist(gen)); });
+
+    // Layer with tracks drawn so far
+    cv::Mat tracks{ cv::Mat::zeros(height, width, CV_8UC3) };
+
+    cv::Mat frame;
+    std::size_t frames{ 0 };
+    std::chrono::duration<double> processing{ 0 };
+    while (cap.read(frame)) {
+        auto start{ std::chrono::steady_clock::now() };
+        flow.process(frame);
+        processing += std::chrono::steady_clock::now() - start;
+        ++frames;
+
+        const auto& old_points{ flow.getGoodOldPoints() };
+        const auto& new_points{ flow.getGoodNewPoints() };
+        for (std::size_t i{ 0 }; i < new_points.size(); ++i) {
+            const auto& color{ colors[i % colors.size()] };
+            cv::line(tracks, new_points[i], old_points[i], color, 2, cv::LINE_AA);
+            cv::circle(frame, new_points[i], 3, color, -1);
+        }
+
+        cv::Mat display;
+        cv::add(frame, tracks, display);
+        out.write(display);
+        cv::imshow("Lucas-Kanade", display);
+
+        auto key{ cv::waitKey(1) };
+        if (key == 'q') {
+            break;
+        }
+        if (key == 'c') { // clear drawn tracks
+            tracks.setTo(cv::Scalar::all(0));
+        }
+    }
+
+    std::println("Frames: {}, tracked points: {}, seeded points: {}", frames, flow.getTrackedPoints(), flow.getSeededPoints());
+    std::println("Tracking: {:.2f} fps, {:.0f} tracked points/s",
+        processing.count() > 0 ? frames / processing.count() : 0.0,
+        processing.count() > 0 ? flow.getTrackedPoints() / processing.count() : 0.0);
+}
+
+void runDense(cv::VideoCapture& cap, cv::VideoWriter& out, int levels, int bands, double preview_scale) {
+    DenseOpticalFlow flow{ levels, bands, preview_scale };
+
+    cv::Mat frame;
+    while (cap.read(frame)) {
+        flow.process(frame);
+        if (flow.getFlow().empty()) {
+            continue;
+        }
+
+        auto visualization{ DenseOpticalFlow::visualize(flow.getFlow()) };
+        out.write(visualization);
+        cv::imshow("Farneback", visualization);
+        if (!flow.getPreviewFlow().empty()) {
+            cv::imshow("Farneback Preview", DenseOpticalFlow::visualize(flow.getPreviewFlow()));
+        }
+
+        if (cv::waitKey(1) == 'q') {
+            break;
+        }
+    }
+
+    std::println("Dense flow {}x{}: {:.2f} fps, {} bands computed {:.2f}x the rows", flow.getFlow().cols, flow.getFlow().rows, flow.getFps(),
+        bands > 0 ? bands : static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u)), flow.getBandOverhead());
+    if (!flow.getPreviewFlow().empty()) {
+        std::println("Dense flow preview {}x{}: {:.2f} fps", flow.getPreviewFlow().cols, flow.getPreviewFlow().rows, flow.getPreviewFps());
+    }
+}
+
+int main(int argc, char** argv) {
+    // Usage: lucas_kanade_optical_flow [sparse|dense] [pyramid levels] [preview scale] [bands]
+    // A single band lets OpenCV thread Farneback, compare its fps with more bands
+    std::string mode{ argc > 1 ? argv[1] : "sparse" };
+    int levels{ argc > 2 ? std::stoi(argv[2]) : 3 };
+    double preview_scale{ argc > 3 ? std::stod(argv[3]) : 0.25 };
+    int bands{ argc > 4 ? std::stoi(argv[4]) : 1 };
+
+    if (mode != "sparse" && mode != "dense") {
+        std::cerr << std::format("Unknown mode: {}, use sparse or dense\n", mode);
+        return EXIT_FAILURE;
+    }
+
     std::filesystem::path path{ "../data/videos/cycle.mp4" };
     if (path.empty()) {
         std::cerr << std::format("Can't load video from: {}\n", path.string());
@@ -172,7 +742,17 @@ int main() {
     int width = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_WIDTH));
     int height = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_HEIGHT));
 
-    cv::VideoWriter out("sparse-output.mp4", cv::VideoWriter::fourcc('M', 'P', '4', 'V'), 20, cv::Size(width, height));
+    cv::VideoWriter out(std::format("{}-output.mp4", mode), cv::VideoWriter::fourcc('M', 'P', '4', 'V'), 20, cv::Size(width, height));
+
+    if (mode == "sparse") {
+        runSparse(cap, out, width, height);
+    }
+    else {
+        runDense(cap, out, levels, bands, preview_scale);
+    }
 
+    cap.release();
+    out.release();
+    cv::destroyAllWindows();
     return 0;
 }